@@ -57,6 +57,7 @@ typedef struct NUIattr  NUIattr;
 typedef struct NUItype  NUItype;
 typedef struct NUIcomp  NUIcomp;
 typedef struct NUIevent NUIevent;
+typedef struct NUIrecord NUIrecord;
 
 typedef struct NUIpool  NUIpool;
 typedef struct NUIdata  NUIdata;
@@ -66,6 +67,17 @@ typedef struct NUItable NUItable;
 
 typedef struct NUIptrentry NUIptrentry;
 
+typedef struct NUIbuffer    NUIbuffer;
+typedef struct NUIkeycache  NUIkeycache;
+typedef struct NUIpoolstats NUIpoolstats;
+typedef struct NUImemstats  NUImemstats;
+
+/* pool pages grow up to this size when NUI_USE_HUGEPAGE defined, so the
+ * alloc hook can back requests of exactly this size with huge pages */
+#ifndef NUI_HUGEPAGESIZE
+# define NUI_HUGEPAGESIZE (2*1024*1024)
+#endif
+
 #ifdef ZN_USE_64BIT_TIMER
 typedef unsigned long long NUItime;
 #else
@@ -77,6 +89,9 @@ typedef unsigned NUItime;
 
 typedef NUItime NUItimerf   (void *ud, NUItimer *timer, NUItime elapsed);
 typedef void    NUIhandlerf (void *ud, NUInode *node, const NUIevent *event);
+typedef int     NUImergef   (void *ud, NUIevent *queued, const NUIevent *event);
+typedef void    NUIobserverf (void *ud, NUInode *node,
+                              const NUIrecord *records, size_t count);
 
 
 /* nui global routines */
@@ -99,6 +114,9 @@ NUI_API NUInode  *nui_newnode (NUIstate *S);
 NUI_API int nui_retain  (NUInode *n);
 NUI_API int nui_release (NUInode *n);
 
+NUI_API size_t nui_newnodes     (NUIstate *S, size_t count, NUInode **nodes);
+NUI_API void   nui_releasenodes (NUInode **nodes, size_t count);
+
 NUI_API NUIstate *nui_state (const NUInode *n);
 
 NUI_API NUInode *nui_parent      (const NUInode *n);
@@ -132,10 +150,13 @@ NUI_API NUIattr *nui_delattr (NUInode *n, NUIkey *key);
 
 NUI_API NUIattr *nui_addattrhandler (NUInode *n, NUIattr *attr);
 NUI_API NUIattr *nui_delattrhandler (NUInode *n, NUIattr *attr);
+NUI_API int      nui_hasattrhandler (const NUInode *n);
 
 NUI_API int      nui_set (NUInode *n, NUIkey *key, const char *v);
 NUI_API NUIdata *nui_get (NUInode *n, NUIkey *key);
 
+NUI_API NUIdata *nui_gettransient (NUInode *n, NUIkey *key);
+
 
 /* nui event handler */
 
@@ -157,6 +178,11 @@ NUI_API void nui_stopevent   (const NUIevent *evt, int stopnow);
 NUI_API void nui_cancelevent (const NUIevent *evt);
 
 NUI_API int  nui_emitevent  (NUInode *n, NUIevent *evt);
+NUI_API int  nui_postevent  (NUInode *n, NUIevent *evt, int flags);
+NUI_API void nui_setmerge   (NUIstate *S, NUIkey *type,
+                             NUImergef *f, void *ud);
+NUI_API void nui_flushevents (NUIstate *S);
+enum NUIpostflags   { NUI_COALESCE = 1 };
 NUI_API void nui_defhandler (NUInode *n, NUIkey *type,
                              NUIhandlerf *h, void *ud);
 NUI_API void nui_addhandler (NUInode *n, NUIkey *type,
@@ -164,6 +190,11 @@ NUI_API void nui_addhandler (NUInode *n, NUIkey *type,
 NUI_API void nui_delhandler (NUInode *n, NUIkey *type,
                              int capture, NUIhandlerf *h, void *ud);
 
+NUI_API int  nui_observe      (NUInode *n, NUIobserverf *f, void *ud);
+NUI_API void nui_unobserve    (NUInode *n, NUIobserverf *f, void *ud);
+NUI_API void nui_flushrecords (NUIstate *S);
+enum NUIrecordtype  { NUI_ADDED = 1, NUI_REMOVED, NUI_ATTRCHANGED };
+
 
 /* nui componemt routines */
 
@@ -171,6 +202,10 @@ NUI_API NUItype *nui_newtype (NUIstate *S, NUIkey *name,
                               size_t size, size_t csize);
 NUI_API NUItype *nui_gettype (NUIstate *S, NUIkey *name);
 
+NUI_API size_t   nui_freezetypes (NUIstate *S);
+
+NUI_API NUItype *nui_nexttype (NUIstate *S, NUItype *curr);
+
 NUI_API NUIcomp *nui_addcomp (NUInode *n, NUItype *t);
 NUI_API NUIcomp *nui_getcomp (NUInode *n, NUItype *t);
 
@@ -191,23 +226,74 @@ NUI_API void nui_canceltimer (NUItimer *t);
 /* nui memory routines */
 
 #define NUI_KEY(S, s) (nui_newkey((S), #s, sizeof(#s)-1))
-#define NUI_(s)     NUI_KEY(S, s)
+#define NUI_(s)     NUI_STATICKEY(S, s)
+
+/* key interned once per callsite and state when NUI_USE_STATICKEY defined;
+ * the callsite cache is process-wide and unsynchronized, so only define it
+ * if all states live in one thread */
+#if defined(__GNUC__) && defined(NUI_USE_STATICKEY)
+# define NUI_STATICKEY(S, s) (__extension__ ({ static NUIkeycache kc_; \
+    kc_.S == (S) ? kc_.key : nui_cachekey((S), &kc_, #s, sizeof(#s)-1); }))
+#else
+# define NUI_STATICKEY(S, s) NUI_KEY(S, s)
+#endif
 
 NUI_API void  nui_initpool (NUIpool *pool, size_t objsize);
 NUI_API void  nui_freepool (NUIstate *S, NUIpool *pool);
 NUI_API void *nui_palloc   (NUIstate *S, NUIpool *pool);
 NUI_API void  nui_pfree    (NUIpool *pool, void *obj);
 
+NUI_API size_t nui_trimpool (NUIstate *S, NUIpool *pool);
+NUI_API size_t nui_trim     (NUIstate *S);
+
+NUI_API void nui_poolstats (const NUIpool *pool, NUIpoolstats *ps);
+NUI_API void nui_memstats  (NUIstate *S, NUImemstats *ms);
+NUI_API void nui_resetpeak (NUIstate *S);
+
 NUI_API NUIdata *nui_newdata (NUIstate *S, const char *s, size_t len);
 NUI_API void     nui_deldata (NUIstate *S, NUIdata *data);
 
+NUI_API NUIdata *nui_newtransient (NUIstate *S, const char *s, size_t len);
+
+#define nui_dropdata(S,data) nui_deldata((S), (data))
+
+NUI_API NUIdata *nui_newshared (NUIstate *S, const char *s, size_t len);
+NUI_API NUIdata *nui_usedata   (NUIstate *S, NUIdata *data);
+NUI_API NUIdata *nui_writedata (NUIstate *S, NUIdata *data);
+
 NUI_API size_t nui_len (NUIdata *data);
 
 NUI_API NUIdata *nui_newfstring  (NUIstate *S, const char *fmt, ...);
 NUI_API NUIdata *nui_newvfstring (NUIstate *S, const char *fmt, va_list l);
 
+/* nui string builder routines */
+
+#ifndef NUI_BUFFERSIZE
+# define NUI_BUFFERSIZE 256
+#endif
+
+#define nui_addchar(B,c) \
+    ((B)->n < (B)->size || nui_prepbuffer((B), 1) ? \
+     (void)((B)->b[(B)->n++] = (char)(c)) : (void)0)
+
+#define nui_addstring(B,s) nui_addlstring((B), (s), strlen(s))
+#define nui_addsize(B,s)   ((B)->n += (s))
+#define nui_bufflen(B)     ((B)->n)
+
+NUI_API void  nui_initbuffer  (NUIstate *S, NUIbuffer *B);
+NUI_API void  nui_freebuffer  (NUIbuffer *B);
+NUI_API char *nui_prepbuffer  (NUIbuffer *B, size_t len);
+NUI_API void  nui_addlstring  (NUIbuffer *B, const char *s, size_t len);
+NUI_API void  nui_addfstring  (NUIbuffer *B, const char *fmt, ...);
+NUI_API void  nui_addvfstring (NUIbuffer *B, const char *fmt, va_list l);
+
+NUI_API NUIdata *nui_buffresult (NUIbuffer *B);
+
 NUI_API NUIkey *nui_newkey (NUIstate *S, const char *s, size_t len);
+NUI_API NUIkey *nui_findkey (NUIstate *S, const char *s, size_t len);
 NUI_API NUIkey *nui_usekey (NUIkey *key);
+NUI_API NUIkey *nui_cachekey (NUIstate *S, NUIkeycache *kc,
+                              const char *s, size_t len);
 NUI_API size_t  nui_keylen (NUIkey *key);
 NUI_API void    nui_delkey (NUIstate *S, NUIkey *key);
 
@@ -220,6 +306,8 @@ NUI_API void nui_freetable (NUIstate *S, NUItable *t);
 NUI_API size_t    nui_resizetable (NUIstate *S, NUItable *t, size_t len);
 NUI_API NUIentry *nui_settable    (NUIstate *S, NUItable *t, void *key);
 
+NUI_API int       nui_deltable    (NUIstate *S, NUItable *t, void *key);
+
 NUI_API const NUIentry *nui_gettable (const NUItable *t, void *key);
 
 NUI_API int nui_nextentry (const NUItable *t, NUIentry **e);
@@ -231,6 +319,46 @@ struct NUIpool {
     void *pages;
     void *freed;
     size_t size;
+    size_t npages;
+    size_t nfree;
+};
+
+struct NUIpoolstats {
+    size_t objsize;
+    size_t live;  /* objects in use */
+    size_t freed; /* length of free list */
+    size_t pages;
+    size_t bytes; /* bytes held by pages */
+};
+
+struct NUImemstats {
+    NUIpoolstats nodes;
+    NUIpoolstats exts;  /* node tables, created on first use */
+    NUIpoolstats handlers;
+    NUIpoolstats timers;
+    NUIpoolstats small; /* all size classes */
+    NUIpoolstats comps; /* all NUItype::comp_pool, see nui_nexttype() */
+    size_t keys;        /* count of keys in string table */
+    size_t keybytes;    /* bytes of string table buckets and keys */
+    size_t tablebytes;  /* bytes of hash parts of all nodes' tables */
+    size_t transient;   /* bytes of transient arena blocks */
+    size_t total;       /* bytes currently got from params->alloc */
+    size_t peak;        /* maximum of total since last nui_resetpeak() */
+};
+
+struct NUIbuffer {
+    char     *b;    /* points to init or to a NUIdata being built */
+    size_t    n;    /* bytes in buffer */
+    size_t    size; /* capacity, without the ending zero */
+    NUIstate *S;
+    char      init[NUI_BUFFERSIZE];
+};
+
+struct NUIkeycache {
+    NUIstate     *S;   /* state of key, NULL if not resolved */
+    NUIkey       *key;
+    NUIkeycache  *next;
+    NUIkeycache **pprev;
 };
 
 struct NUIentry {
@@ -240,7 +368,8 @@ struct NUIentry {
 
 struct NUItable {
     size_t    size;
-    size_t    entrysize;
+    unsigned  entrysize;
+    unsigned  count;
     size_t    lastfree;
     NUIentry *hash;
 };
@@ -254,6 +383,7 @@ struct NUIparams {
     int     (*wait) (NUIparams *params, NUItime time);
 
     NUIstate *S;
+    size_t trim_threshold; /* free pool bytes to trim in nui_waitevents */
 };
 
 struct NUIattr {
@@ -281,11 +411,20 @@ struct NUIevent {
     NUItable  data; /* mutable */
 };
 
+struct NUIrecord {
+    int       type;   /* NUI_ADDED, NUI_REMOVED or NUI_ATTRCHANGED */
+    NUInode  *target; /* parent of nodes, or node of changed key */
+    NUIkey   *key;
+    NUInode **nodes;  /* children added or removed, in order */
+    size_t    count;
+};
+
 struct NUItype {
     NUIkey *name;
     NUIpool comp_pool;
     size_t  type_size;
     size_t  comp_size;
+    size_t  index; /* 1-based dense index from nui_freezetypes(), or 0 */
 
     NUItype **(*depends) (NUItype *t, size_t *plen);
 
@@ -309,18 +448,45 @@ NUI_NS_END
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
 #define NUI_POOLSIZE                  4096
+#define NUI_POOLGROWTH                4
+#ifdef NUI_USE_HUGEPAGE
+# define NUI_MAX_POOLSIZE             NUI_HUGEPAGESIZE
+#else
+# define NUI_MAX_POOLSIZE             (64*1024)
+#endif
+#define NUI_MIN_POOLOBJS              4
 #define NUI_MIN_TIMERHEAP             128
 #define NUI_MIN_STRTABLE_SIZE         32
-#define NUI_HASHLIMIT                 5
-#define NUI_MIN_HASHSIZE              4
+#define NUI_REHASHSTEP                4   /* buckets moved per key op */
+#define NUI_REHASHTICK                256 /* buckets moved per tick */
+#define NUI_GCSTEP                    256 /* dead keys swept per tick */
+#define NUI_HASHLIMIT                 5 /* for NUI_HASH_SAMPLE */
+#define NUI_MIN_HASHSIZE              8
+#define NUI_LINEARSIZE                4 /* searched linearly up to it */
+#define NUI_MIN_PATHSIZE              32
+#define NUI_HOTEVENTS                 8 /* builtin ids, then first user ids */
+#define NUI_MIN_RECORDS              16
 #define NUI_MAX_EVENTLEVEL            100
 
-#define NUI_MIN_ESIZE                 (sizeof(NUIentry)*NUI_MIN_HASHSIZE)
-#define NUI_SMALLSIZE                 (NUI_MIN_ESIZE > 64 ? NUI_MIN_ESIZE:64)
+#define NUI_SIZESTEP                  16
+#define NUI_SMALLSIZE                 1024
+
+/* key hash functions: NUI_HASH_SAMPLE hashes at most 32 chars of key,
+ * NUI_HASH_MIX64 mixes all chars in 64 bits and folds it to 32 bits */
+#define NUI_HASH_SAMPLE    1
+#define NUI_HASH_MIX64     2
+#ifndef NUI_HASH
+# define NUI_HASH          NUI_HASH_MIX64
+#endif
+
+#define NUI_TRANSIENT      (~(~0u>>1)) /* flags in length of NUIdata */
+#define NUI_SHARED         (NUI_TRANSIENT>>1) /* refcount before length */
+#define NUI_MAX_DATALEN    (~0u>>2)
 
 #define NUI_TIMER_NOINDEX  (~(unsigned)0)
 #define NUI_FOREVER        (~(NUItime)0)
@@ -339,10 +505,42 @@ enum NUIbuiltinkeys {
     NUI_MAX_BUILTINS
 };
 
+/* size classes of small memory pools, last one must be NUI_SMALLSIZE */
+#define nui_sizeclasses(X) \
+    X(16) X(32) X(48) X(64) X(96) X(128) X(256) X(512) X(1024)
+
+enum NUIsizeclasses {
+#define X(size) NUI_SIZE_##size,
+    nui_sizeclasses(X)
+#undef  X
+    NUI_SIZECLASSES
+};
+
 typedef struct NUItimerstate NUItimerstate;
 typedef struct NUIkeyentry   NUIkeyentry;
 typedef struct NUIkeytable   NUIkeytable;
+typedef struct NUItypehash   NUItypehash;
 typedef struct NUIhandlers   NUIhandlers;
+typedef struct NUIlistener   NUIlistener;
+typedef struct NUIlisteners  NUIlisteners;
+typedef struct NUIposted     NUIposted;
+typedef struct NUIpostqueue  NUIpostqueue;
+typedef struct NUIobserver   NUIobserver;
+typedef struct NUIpending    NUIpending;
+typedef struct NUIobserved   NUIobserved;
+typedef struct NUInodeext    NUInodeext;
+typedef struct NUIpage       NUIpage;
+typedef struct NUIarena      NUIarena;
+
+struct NUIpage {
+    NUIpage *next;
+    size_t   size;
+};
+
+struct NUIarena {
+    NUIpage *blocks; /* current block first */
+    size_t   used;   /* bytes used in current block */
+};
 
 struct NUItimer {
     union { NUItimer *next; void *ud; } u;
@@ -363,42 +561,118 @@ struct NUItimerstate {
 
 struct NUIkeyentry {
     NUIkeyentry *next;
+    NUIkeyentry *nextgc; /* in gclist if ingc set */
     unsigned hash;
-    unsigned ref;
+    unsigned ref  : 31;
+    unsigned ingc : 1;
 };
 
 struct NUIkeytable {
     NUIkeyentry **hash;
-    size_t nuse;
+    NUIkeyentry **oldhash; /* buckets not yet moved to hash */
+    size_t nuse;           /* keys in both hash and oldhash */
     size_t size;
+    size_t oldsize;
+    size_t rehashidx;      /* buckets below it in oldhash are moved */
+    NUIkeyentry *gclist;   /* keys lost last reference, maybe revived */
+    NUIkeyentry *oldgc;    /* gclist of last tick, to be swept */
     unsigned seed;
 };
 
+struct NUItypehash {
+    NUItype **slots; /* frozen types, power of 2 */
+    unsigned *disp;  /* displacement of each bucket */
+    size_t    size;
+    size_t    nbuckets;
+    unsigned  mult;
+    unsigned  shift;
+};
+
 struct NUIhandlers {
     NUIhandlers *next;
-    union {
-        NUIattr     *attr;
-        NUIhandlerf *handler;
-    } u;
-    void *ud;
-    unsigned level   : 16;
-    unsigned capture : 1;
-    unsigned running : 1;
-    unsigned dead    : 1;
+    NUIattr     *attr;
+};
+
+struct NUIlistener {
+    NUIhandlerf *handler;
+    void        *ud;
+    unsigned level : 16;
+    unsigned dead  : 1;
+};
+
+struct NUIlisteners {   /* handlers of an event type on a node */
+    NUIlistener *items; /* default, then capture, then bubble ones */
+    unsigned ncapture;
+    unsigned count;     /* used items, with default one */
+    unsigned size;
+    unsigned running  : 16;
+    unsigned havedead : 1;
+};
+
+struct NUIposted {
+    NUInode *node;
+    NUIevent evt;
+    int      flags;
+};
+
+struct NUIpostqueue {
+    NUIposted *events;
+    size_t     count;
+    size_t     size;
+    size_t    *index;     /* coalesced events by (node, type), 1-based */
+    size_t     indexsize;
+    size_t     ncoalesce;
+};
+
+struct NUIobserver {
+    NUInode      *node;
+    NUIobserverf *f;    /* NULL if removed while flushing */
+    void         *ud;
+};
+
+struct NUIpending {
+    int      type;
+    NUInode *target;
+    NUIkey  *key;
+    size_t   first; /* index of nodes in NUIobserved::nodes */
+    size_t   count;
+};
+
+struct NUIobserved {
+    NUIobserver *observers;
+    size_t       nobservers;
+    size_t       obsize;
+    NUIpending  *records;
+    size_t       count;
+    size_t       size;
+    NUInode    **nodes;  /* added or removed nodes of all records */
+    size_t       ncount;
+    size_t       nsize;
+    NUIrecord   *out;    /* records of one observer when flushing */
+    size_t       outsize;
+    unsigned     running  : 16;
+    unsigned     havedead : 1;
+};
+
+struct NUInodeext {
+    NUItable      comps;
+    NUItable      attrs;
+    NUItable      handlers;
+    NUIhandlers  *attrhandlers;
+    NUIlisteners *hot[NUI_HOTEVENTS]; /* handlers by event id */
 };
 
 struct NUInode {
-    NUInode  *parent;
-    NUInode  *prev_sibling;
-    NUInode  *next_sibling;
-    NUInode  *children;
-    NUIstate *S;
-    int       child_count;
-    int       ref;
-    NUItable  comps;
-    NUItable  attrs;
-    NUItable  handlers;
-    NUIhandlers *attrhandlers;
+    NUInode    *parent;
+    NUInode    *prev_sibling;
+    NUInode    *next_sibling;
+    NUInode    *children;
+    NUIstate   *S;
+    NUInodeext *ext; /* NULL until first comp/attr/handler */
+    int         child_count;
+    int         ref;
+    unsigned    listenmask; /* event id bits it listens to */
+    unsigned    pathmask;   /* listenmask of it and its ancestors */
 };
 
 struct NUIstate {
@@ -407,46 +681,103 @@ struct NUIstate {
     NUInode      *freenodes;
     NUIkeytable   strt;
     NUItable      types;
+    NUItypehash   frozen;
+    NUItable      evtypes;  /* event id of types ever listened to */
+    size_t        nlisteners[NUI_HOTEVENTS]; /* nodes listening by hot id */
+    NUIevent      mutation; /* reused by builtin events, see mutating */
+    int           mutating;
+    NUIpostqueue  posted;
+    NUIobserved   observed;
     NUItimerstate timers;
     NUIpool       handlerpool;
     NUIpool       nodepool;
-    NUIpool       smallpool;
+    NUIpool       extpool;
+    NUIpool       smallpools[NUI_SIZECLASSES];
+    unsigned char sizeindex[NUI_SMALLSIZE/NUI_SIZESTEP + 1];
+    size_t        memtotal;
+    size_t        mempeak;
+    size_t        trimfree; /* free pool bytes kept by last auto trim */
+    NUIarena      transient;
     NUIkey       *builtins[NUI_MAX_BUILTINS];
+    NUIkeycache  *keycaches;
+    NUInode     **path;     /* event paths, nested emits stacked */
+    size_t        pathtop;
+    size_t        pathsize;
 };
 
 
 /* memory */
 
 NUI_API size_t nui_len(NUIdata *data)
-{ return data ? ((unsigned*)data)[-1] : 0; }
+{ return data ? ((unsigned*)data)[-1] & NUI_MAX_DATALEN : 0; }
+
+#define nuiM_smallpool(S, sz) \
+    (&(S)->smallpools[(S)->sizeindex[((sz)+NUI_SIZESTEP-1)/NUI_SIZESTEP]])
+
+static void nuiM_initpools(NUIstate *S) {
+    static const size_t sizes[] = {
+#define X(size) size,
+        nui_sizeclasses(X)
+#undef  X
+    };
+    size_t i, idx = 0;
+    assert(sizes[NUI_SIZECLASSES-1] == NUI_SMALLSIZE);
+    for (i = 0; i < NUI_SIZECLASSES; ++i)
+        nui_initpool(&S->smallpools[i], sizes[i]);
+    for (i = 0; i <= NUI_SMALLSIZE/NUI_SIZESTEP; ++i) {
+        while (sizes[idx] < i*NUI_SIZESTEP) ++idx;
+        S->sizeindex[i] = (unsigned char)idx;
+    }
+}
+
+static void nuiM_freepools(NUIstate *S) {
+    size_t i;
+    for (i = 0; i < NUI_SIZECLASSES; ++i)
+        nui_freepool(S, &S->smallpools[i]);
+}
+
+static void nuiM_account(NUIstate *S, size_t nz, size_t oz) {
+    S->memtotal += nz;
+    S->memtotal -= oz;
+    if (S->memtotal > S->mempeak) S->mempeak = S->memtotal;
+}
 
 static void *nuiM_malloc(NUIstate *S, size_t sz) {
     void *ptr;
     if (sz <= NUI_SMALLSIZE)
-        return nui_palloc(S, &S->smallpool);
+        return nui_palloc(S, nuiM_smallpool(S, sz));
     ptr = S->params->alloc(S->params, NULL, sz, 0);
     if (ptr == NULL) ptr = S->params->nomem(S->params, NULL, sz, 0);
+    if (ptr != NULL) nuiM_account(S, sz, 0);
     return ptr;
 }
 
 static void nuiM_free(NUIstate *S, void *ptr, size_t oz) {
     if (ptr == NULL || oz == 0) return;
     if (oz <= NUI_SMALLSIZE) {
-        nui_pfree(&S->smallpool, ptr);
+        nui_pfree(nuiM_smallpool(S, oz), ptr);
         return;
     }
     ptr = S->params->alloc(S->params, ptr, 0, oz);
     assert(ptr == NULL);
+    nuiM_account(S, 0, oz);
 }
 
 static void *nuiM_realloc(NUIstate *S, void *ptr, size_t nz, size_t oz) {
     void *newptr;
+    if (ptr == NULL || oz == 0) return nuiM_malloc(S, nz);
     if (oz <= NUI_SMALLSIZE || nz <= NUI_SMALLSIZE) {
+        if (oz <= NUI_SMALLSIZE && nz <= NUI_SMALLSIZE
+                && nuiM_smallpool(S, oz) == nuiM_smallpool(S, nz))
+            return ptr; /* same size class, keep it in place */
+        if ((newptr = nuiM_malloc(S, nz)) == NULL) return NULL;
+        memcpy(newptr, ptr, oz < nz ? oz : nz);
         nuiM_free(S, ptr, oz);
-        return nuiM_malloc(S, nz);
+        return newptr;
     }
     newptr = S->params->alloc(S->params, ptr, nz, oz);
     if (newptr == NULL) newptr = S->params->nomem(S->params, ptr, nz, oz);
+    if (newptr != NULL) nuiM_account(S, nz, oz);
     return newptr;
 }
 
@@ -466,62 +797,257 @@ NUI_API void nui_initpool(NUIpool *pool, size_t objsize) {
     pool->pages = NULL;
     pool->freed = NULL;
     pool->size = objsize;
+    pool->npages = 0;
+    pool->nfree = 0;
     assert(((sp - 1) & sp) == 0);
     assert(objsize >= sp && objsize % sp == 0);
-    assert(NUI_POOLSIZE / objsize > 2);
 }
 
 NUI_API void nui_freepool(NUIstate *S, NUIpool *pool) {
-    const size_t offset = NUI_POOLSIZE - sizeof(void*);
     while (pool->pages != NULL) {
-        void *next = *(void**)((char*)pool->pages + offset);
-        nuiM_free(S, pool->pages, NUI_POOLSIZE);
-        pool->pages = next;
+        NUIpage *page = (NUIpage*)pool->pages;
+        pool->pages = page->next;
+        nuiM_free(S, page, page->size);
     }
     nui_initpool(pool, pool->size);
 }
 
+static size_t nuiM_pagesize(NUIpool *pool) {
+    NUIpage *last = (NUIpage*)pool->pages;
+    size_t size = last ? last->size*NUI_POOLGROWTH : NUI_POOLSIZE;
+    if (size > NUI_MAX_POOLSIZE) size = NUI_MAX_POOLSIZE;
+    while ((size - sizeof(NUIpage))/pool->size < NUI_MIN_POOLOBJS)
+        size <<= 1; /* large objects */
+    return size;
+}
+
+static void *nuiM_newpage(NUIstate *S, NUIpool *pool, size_t *pkeep) {
+    size_t size = nuiM_pagesize(pool);
+    size_t count = (size - sizeof(NUIpage))/pool->size;
+    size_t keep = *pkeep < count ? *pkeep : count; /* objects returned */
+    NUIpage *newpage = (NUIpage*)nuiM_malloc(S, size);
+    char *obj, *end;
+    if (newpage == NULL) return NULL;
+    *pkeep = keep;
+    newpage->next = (NUIpage*)pool->pages;
+    newpage->size = size;
+    pool->pages = newpage;
+    ++pool->npages;
+    pool->nfree += count - keep;
+    obj = (char*)(newpage + 1) + keep*pool->size;
+    end = (char*)(newpage + 1) + count*pool->size;
+    while (end != obj) { /* first free object comes first */
+        end -= pool->size;
+        *(void**)end = pool->freed;
+        pool->freed = end;
+    }
+    return newpage + 1;
+}
+
 NUI_API void *nui_palloc(NUIstate *S, NUIpool *pool) {
     void *obj = pool->freed;
-    if (obj == NULL) {
-        const size_t offset = NUI_POOLSIZE - sizeof(void*);
-        void *end, *newpage = nuiM_malloc(S, NUI_POOLSIZE);
-        if (newpage == NULL) return NULL;
-        *(void**)((char*)newpage + offset) = pool->pages;
-        pool->pages = newpage;
-        end = (char*)newpage + (offset/pool->size-1)*pool->size;
-        while (end != newpage) {
-            *(void**)end = pool->freed;
-            pool->freed = (void**)end;
-            end = (char*)end - pool->size;
-        }
-        return end;
-    }
+    size_t keep = 1;
+    if (obj == NULL)
+        return nuiM_newpage(S, pool, &keep);
     pool->freed = *(void**)obj;
+    --pool->nfree;
     return obj;
 }
 
 NUI_API void nui_pfree(NUIpool *pool, void *obj) {
     *(void**)obj = pool->freed;
     pool->freed = obj;
+    ++pool->nfree;
 }
 
-NUI_API NUIdata *nui_newdata(NUIstate *S, const char *s, size_t len) {
-    size_t size = sizeof(unsigned) + len + 1;
-    char *buff;
-    NUIdata *data = (NUIdata*)nuiM_malloc(S, size);
-    *(unsigned*)data = (unsigned)len;
-    buff = (char*)((unsigned*)data+1);
+typedef struct NUIpageinfo {
+    NUIpage *page;
+    size_t   nfree;
+    size_t   count;
+} NUIpageinfo;
+
+static int nuiM_pagecmp(const void *lhs, const void *rhs) {
+    const char *l = (const char*)((const NUIpageinfo*)lhs)->page;
+    const char *r = (const char*)((const NUIpageinfo*)rhs)->page;
+    return l < r ? -1 : l > r;
+}
+
+static NUIpageinfo *nuiM_findpage(NUIpageinfo *pages, size_t n, void *obj) {
+    size_t lo = 0, hi = n; /* last page starts before obj */
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo)/2;
+        if ((char*)obj < (char*)pages[mid].page) hi = mid;
+        else lo = mid;
+    }
+    return &pages[lo];
+}
+
+NUI_API size_t nui_trimpool(NUIstate *S, NUIpool *pool) {
+    size_t i, n = pool->npages, released = 0;
+    NUIpageinfo *pages;
+    NUIpage **pp;
+    void **pobj, *obj;
+    if (pool->size == 0 || pool->nfree < NUI_MIN_POOLOBJS)
+        return 0;
+    /* scratch space comes from outside any pool, as we are trimming one */
+    pages = (NUIpageinfo*)S->params->alloc(S->params, NULL,
+            n*sizeof(NUIpageinfo), 0);
+    if (pages == NULL) return 0;
+    nuiM_account(S, n*sizeof(NUIpageinfo), 0);
+    pp = (NUIpage**)&pool->pages;
+    for (i = 0; i < n; ++i, pp = &(*pp)->next) {
+        pages[i].page = *pp;
+        pages[i].nfree = 0;
+        pages[i].count = ((*pp)->size - sizeof(NUIpage))/pool->size;
+    }
+    qsort(pages, n, sizeof(NUIpageinfo), nuiM_pagecmp);
+    for (obj = pool->freed; obj != NULL; obj = *(void**)obj)
+        ++nuiM_findpage(pages, n, obj)->nfree;
+    for (pobj = &pool->freed; *pobj != NULL;) { /* unlink from empty pages */
+        NUIpageinfo *info = nuiM_findpage(pages, n, *pobj);
+        if (info->nfree == info->count)
+            *pobj = *(void**)*pobj;
+        else
+            pobj = (void**)*pobj;
+    }
+    for (pp = (NUIpage**)&pool->pages; *pp != NULL;) {
+        NUIpage *page = *pp;
+        NUIpageinfo *info = nuiM_findpage(pages, n, page);
+        if (info->nfree != info->count)
+            pp = &page->next;
+        else {
+            *pp = page->next;
+            --pool->npages;
+            pool->nfree -= info->count;
+            released += page->size;
+            nuiM_free(S, page, page->size);
+        }
+    }
+    S->params->alloc(S->params, pages, 0, n*sizeof(NUIpageinfo));
+    nuiM_account(S, 0, n*sizeof(NUIpageinfo));
+    return released;
+}
+
+NUI_API void nui_poolstats(const NUIpool *pool, NUIpoolstats *ps) {
+    const NUIpage *page;
+    size_t objects = 0;
+    ps->objsize = pool->size;
+    ps->freed = pool->nfree;
+    ps->pages = pool->npages;
+    ps->bytes = 0;
+    for (page = (NUIpage*)pool->pages; page != NULL; page = page->next) {
+        objects += (page->size - sizeof(NUIpage))/pool->size;
+        ps->bytes += page->size;
+    }
+    ps->live = objects - pool->nfree;
+}
+
+static void nuiM_addstats(NUIpoolstats *ps, const NUIpool *pool) {
+    NUIpoolstats pps;
+    nui_poolstats(pool, &pps);
+    ps->live  += pps.live;
+    ps->freed += pps.freed;
+    ps->pages += pps.pages;
+    ps->bytes += pps.bytes;
+}
+
+#define nuiM_arenasize(sz) (((sz) + sizeof(void*)-1) & ~(sizeof(void*)-1))
+
+static void *nuiM_arenaalloc(NUIstate *S, NUIarena *a, size_t sz) {
+    NUIpage *block = a->blocks;
+    void *ptr;
+    sz = nuiM_arenasize(sz);
+    if (block == NULL || block->size - a->used < sz) {
+        size_t size = block ? block->size*2 : NUI_POOLSIZE;
+        while (size - sizeof(NUIpage) < sz) size <<= 1;
+        if ((block = (NUIpage*)nuiM_malloc(S, size)) == NULL)
+            return NULL;
+        block->next = a->blocks;
+        block->size = size;
+        a->blocks = block;
+        a->used = sizeof(NUIpage);
+    }
+    ptr = (char*)block + a->used;
+    a->used += sz;
+    return ptr;
+}
+
+static void nuiM_arenafree(NUIarena *a, void *ptr, size_t sz) {
+    /* only the last allocation can be given back */
+    if ((char*)ptr + nuiM_arenasize(sz) == (char*)a->blocks + a->used)
+        a->used -= nuiM_arenasize(sz);
+}
+
+static void nuiM_arenareset(NUIstate *S, NUIarena *a, int keep) {
+    NUIpage *block = a->blocks, *next;
+    if (block == NULL) return;
+    for (next = keep ? block->next : block; next != NULL;) {
+        NUIpage *curr = next;
+        next = next->next;
+        nuiM_free(S, curr, curr->size);
+    }
+    if (!keep) a->blocks = NULL;
+    else block->next = NULL;
+    a->used = sizeof(NUIpage);
+}
+
+static NUIdata *nuiM_initdata(void *header, const char *s, size_t len, unsigned flags) {
+    char *buff = (char*)((unsigned*)header+1);
+    assert(len <= NUI_MAX_DATALEN);
+    *(unsigned*)header = (unsigned)len | flags;
     if (s != NULL) { memcpy(buff, s, len); buff[len] = '\0'; }
     return (NUIdata*)buff;
 }
 
+NUI_API NUIdata *nui_newdata(NUIstate *S, const char *s, size_t len) {
+    void *header = nuiM_malloc(S, sizeof(unsigned) + len + 1);
+    return header ? nuiM_initdata(header, s, len, 0) : NULL;
+}
+
+NUI_API NUIdata *nui_newtransient(NUIstate *S, const char *s, size_t len) {
+    void *header = nuiM_arenaalloc(S, &S->transient,
+            sizeof(unsigned) + len + 1);
+    return header ? nuiM_initdata(header, s, len, NUI_TRANSIENT) : NULL;
+}
+
+NUI_API NUIdata *nui_newshared(NUIstate *S, const char *s, size_t len) {
+    unsigned *header = (unsigned*)nuiM_malloc(S,
+            sizeof(unsigned)*2 + len + 1);
+    if (header == NULL) return NULL;
+    *header = 1; /* reference count */
+    return nuiM_initdata(header+1, s, len, NUI_SHARED);
+}
+
+NUI_API NUIdata *nui_usedata(NUIstate *S, NUIdata *data) {
+    unsigned *header = (unsigned*)data-1;
+    if (data == NULL) return NULL;
+    if ((*header & NUI_SHARED) == 0)
+        return nui_newshared(S, (const char*)data, nui_len(data));
+    ++header[-1];
+    return data;
+}
+
+NUI_API NUIdata *nui_writedata(NUIstate *S, NUIdata *data) {
+    unsigned *header = (unsigned*)data-1;
+    NUIdata *copy;
+    if (data == NULL || (*header & NUI_SHARED) == 0 || header[-1] == 1)
+        return data;
+    copy = nui_newdata(S, (const char*)data, nui_len(data));
+    if (copy != NULL) --header[-1];
+    return copy;
+}
+
 NUI_API void nui_deldata(NUIstate *S, NUIdata *data) {
-    void *header = (unsigned*)data-1;
+    unsigned *header = (unsigned*)data-1;
     size_t len;
     if (data == NULL) return;
-    len = *(unsigned*)header;
-    nuiM_free(S, header, sizeof(unsigned) + len + 1);
+    len = nui_len(data);
+    if ((*header & NUI_TRANSIENT) != 0)
+        nuiM_arenafree(&S->transient, header, sizeof(unsigned) + len + 1);
+    else if ((*header & NUI_SHARED) == 0)
+        nuiM_free(S, header, sizeof(unsigned) + len + 1);
+    else if (--header[-1] == 0)
+        nuiM_free(S, header-1, sizeof(unsigned)*2 + len + 1);
 }
 
 NUI_API NUIdata *nui_newfstring(NUIstate *S, const char *fmt, ...) {
@@ -534,19 +1060,100 @@ NUI_API NUIdata *nui_newfstring(NUIstate *S, const char *fmt, ...) {
 }
 
 NUI_API NUIdata *nui_newvfstring(NUIstate *S, const char *fmt, va_list l) {
-    va_list l_count;
-    NUIdata *data;
+    NUIbuffer B;
+    nui_initbuffer(S, &B);
+    nui_addvfstring(&B, fmt, l);
+    if (nui_bufflen(&B) != 0)
+        return nui_buffresult(&B);
+    nui_freebuffer(&B);
+    return NULL;
+}
+
+
+/* string builder */
+
+#define nuiB_header(B) ((unsigned*)(B)->b - 1)
+#define nuiB_alloced(size) (sizeof(unsigned) + (size) + 1)
+
+NUI_API void nui_initbuffer(NUIstate *S, NUIbuffer *B) {
+    B->b = B->init;
+    B->n = 0;
+    B->size = NUI_BUFFERSIZE - 1;
+    B->S = S;
+}
+
+NUI_API void nui_freebuffer(NUIbuffer *B) {
+    if (B->b != B->init)
+        nuiM_free(B->S, nuiB_header(B), nuiB_alloced(B->size));
+    nui_initbuffer(B->S, B);
+}
+
+NUI_API char *nui_prepbuffer(NUIbuffer *B, size_t len) {
+    size_t newsize = B->b == B->init ? 0 : nuiB_alloced(B->size)*2;
+    void *header;
+    if (B->size - B->n >= len) return B->b + B->n;
+    if (newsize < nuiB_alloced(B->n + len)) /* first block just fits */
+        newsize = nuiB_alloced(B->n + len);
+    if (newsize <= NUI_SMALLSIZE) /* use the whole size class */
+        newsize = nuiM_smallpool(B->S, newsize)->size;
+    if (B->b == B->init) {
+        if ((header = nuiM_malloc(B->S, newsize)) != NULL)
+            memcpy((unsigned*)header + 1, B->init, B->n);
+    }
+    else header = nuiM_realloc(B->S, nuiB_header(B),
+            newsize, nuiB_alloced(B->size));
+    if (header == NULL) return NULL;
+    B->b = (char*)((unsigned*)header + 1);
+    B->size = newsize - nuiB_alloced(0);
+    return B->b + B->n;
+}
+
+NUI_API void nui_addlstring(NUIbuffer *B, const char *s, size_t len) {
+    char *p = nui_prepbuffer(B, len);
+    if (p == NULL) return;
+    memcpy(p, s, len);
+    nui_addsize(B, len);
+}
+
+NUI_API void nui_addfstring(NUIbuffer *B, const char *fmt, ...) {
+    va_list l;
+    va_start(l, fmt);
+    nui_addvfstring(B, fmt, l);
+    va_end(l);
+}
+
+NUI_API void nui_addvfstring(NUIbuffer *B, const char *fmt, va_list l) {
+    va_list l_retry;
     int len;
 #ifdef va_copy
-    va_copy(l_count, l);
+    va_copy(l_retry, l);
 #else
-    __va_copy(l_count, l);
+    __va_copy(l_retry, l);
 #endif
-    len = nuiM_vsnprintf(NULL, 0, fmt, l_count);
-    va_end(l_count);
-    if (len <= 0) return NULL;
-    data = nui_newdata(S, NULL, len);
-    nuiM_vsnprintf((char*)data, len+1, fmt, l);
+    len = nuiM_vsnprintf(B->b + B->n, B->size - B->n + 1, fmt, l);
+    if (len > 0 && (size_t)len > B->size - B->n) { /* not fit, retry */
+        char *p = nui_prepbuffer(B, len);
+        if (p == NULL) len = 0;
+        else nuiM_vsnprintf(p, len + 1, fmt, l_retry);
+    }
+    va_end(l_retry);
+    if (len > 0) nui_addsize(B, len);
+}
+
+NUI_API NUIdata *nui_buffresult(NUIbuffer *B) {
+    void *header;
+    NUIdata *data;
+    if (B->b == B->init)
+        return nui_newdata(B->S, B->init, B->n);
+    header = nuiB_header(B); /* keep block if result has its size class */
+    if (nuiB_alloced(B->size) > NUI_SMALLSIZE
+            || nuiM_smallpool(B->S, nuiB_alloced(B->n))
+            != nuiM_smallpool(B->S, nuiB_alloced(B->size)))
+        header = nuiM_realloc(B->S, header,
+                nuiB_alloced(B->n), nuiB_alloced(B->size));
+    data = header ? nuiM_initdata(header, NULL, B->n, 0) : NULL;
+    if (data) ((char*)data)[B->n] = '\0';
+    nui_initbuffer(B->S, B);
     return data;
 }
 
@@ -563,49 +1170,102 @@ NUI_API NUIkey *nui_usekey(NUIkey *key)
 NUI_API size_t nui_keylen(NUIkey *key)
 { return !key ? 0:nui_len((NUIdata*)nuiS_header(key)) - sizeof(NUIkeyentry); }
 
+static void nuiS_rehash(NUIstate *S, size_t n) {
+    NUIkeytable *kp = &S->strt;
+    size_t empties = n*10; /* max empty buckets to visit */
+    if (kp->oldhash == NULL) return;
+    while (n > 0 && kp->rehashidx < kp->oldsize) {
+        NUIkeyentry *o = kp->oldhash[kp->rehashidx];
+        kp->oldhash[kp->rehashidx++] = NULL;
+        if (o == NULL) {
+            if (--empties == 0) break;
+            continue;
+        }
+        while (o) { /* for each node in the list */
+            NUIkeyentry *next = o->next; /* save next */
+            NUIkeyentry **list = &kp->hash[nui_lmod(o->hash, kp->size)];
+            o->next = *list;
+            *list = o;
+            o = next;
+        }
+        --n;
+    }
+    if (kp->rehashidx == kp->oldsize) {
+        nuiM_free(S, kp->oldhash, kp->oldsize*sizeof(NUIkeyentry*));
+        kp->oldhash = NULL;
+        kp->oldsize = kp->rehashidx = 0;
+    }
+}
+
 static void nuiS_resize(NUIstate *S, size_t newsize) {
-    NUIkeytable  oldstrt = S->strt;
-    NUIkeytable *newstrt = &S->strt;
+    NUIkeytable *kp = &S->strt;
+    NUIkeyentry **hash;
     size_t i, realsize = NUI_MIN_STRTABLE_SIZE;
     while (realsize < NUI_MAX_SIZET/2/sizeof(NUIkey*) && realsize < newsize)
         realsize *= 2;
-    newstrt->hash = (NUIkeyentry**)nuiM_malloc(S,
-            realsize*sizeof(NUIkeyentry*));
-    newstrt->size = realsize;
-    for (i = 0; i < newstrt->size; ++i) newstrt->hash[i] = NULL;
-    for (i = 0; i < oldstrt.size; ++i) {
-        NUIkeyentry *s = oldstrt.hash[i];
-        while (s) { /* for each node in the list */
-            NUIkeyentry *next = s->next; /* save next */
-            unsigned h = nui_lmod(s->hash, realsize);
-            s->next = newstrt->hash[h];
-            newstrt->hash[h] = s;
-            s = next;
-        }
+    if (kp->oldhash != NULL || realsize == kp->size)
+        return; /* wait last rehash to finish */
+    hash = (NUIkeyentry**)nuiM_malloc(S, realsize*sizeof(NUIkeyentry*));
+    if (hash == NULL) return;
+    for (i = 0; i < realsize; ++i) hash[i] = NULL;
+    if (kp->size != 0) { /* move old buckets incrementally */
+        kp->oldhash = kp->hash;
+        kp->oldsize = kp->size;
+        kp->rehashidx = 0;
     }
-    nuiM_free(S, oldstrt.hash, oldstrt.size*sizeof(NUIkeyentry*));
+    kp->hash = hash;
+    kp->size = realsize;
 }
 
-static unsigned nui_calchash(NUIstate *S, const char *s, size_t len) {
-    unsigned h = S->strt.seed ^ (unsigned)len;
+#if NUI_HASH == NUI_HASH_SAMPLE
+static unsigned nuiS_hashbytes(const char *s, size_t len, unsigned seed) {
+    unsigned h = seed ^ (unsigned)len;
     size_t l1;
     size_t step = (len >> NUI_HASHLIMIT) + 1;
     for (l1 = len; l1 >= step; l1 -= step)
         h = h ^ ((h<<5) + (h>>2) + (unsigned char)(s[l1 - 1]));
     return h;
 }
+#elif NUI_HASH == NUI_HASH_MIX64
+static unsigned nuiS_hashbytes(const char *s, size_t len, unsigned seed) {
+    const unsigned long long m = 0xc6a4a7935bd1e995ULL; /* MurmurHash64A */
+    unsigned long long h = seed ^ (len * m), k = 0;
+    const char *end = s + (len & ~(size_t)7);
+    for (; s != end; s += 8) {
+        memcpy(&k, s, 8);
+        k *= m; k ^= k >> 47; k *= m;
+        h ^= k; h *= m;
+    }
+    if ((len & 7) != 0) {
+        k = 0;
+        memcpy(&k, s, len & 7);
+        h ^= k; h *= m;
+    }
+    h ^= h >> 47; h *= m; h ^= h >> 47;
+    return (unsigned)(h ^ (h >> 32));
+}
+#else
+# error "unknown NUI_HASH"
+#endif
+
+static unsigned nui_calchash(NUIstate *S, const char *s, size_t len)
+{ return nuiS_hashbytes(s, len, S->strt.seed); }
 
 static NUIkey *nuiS_new(NUIstate *S, const char *s, size_t len, unsigned h) {
     NUIkeyentry **list;  /* (pointer to) list where it will be inserted */
     NUIkeytable *kp = &S->strt;
     NUIkeyentry *o;
     if (s == NULL || len == 0) return NULL;
+    nuiS_rehash(S, NUI_REHASHSTEP);
     if (kp->nuse >= kp->size && kp->size <= NUI_MAX_SIZET/2)
         nuiS_resize(S, kp->size*2);  /* too crowded */
     list = &kp->hash[nui_lmod(h, kp->size)];
     o = (NUIkeyentry*)nui_newdata(S, NULL, sizeof(NUIkeyentry)+len);
-    o->hash = nui_calchash(S, s, len);
+    o->hash = h;
     o->ref  = 0;
+    o->ingc = 1; /* swept if nobody uses it */
+    o->nextgc = kp->gclist;
+    kp->gclist = o;
     o->next = *list;
     *list = o;
     memcpy(o+1, s, len);
@@ -614,12 +1274,8 @@ static NUIkey *nuiS_new(NUIstate *S, const char *s, size_t len, unsigned h) {
     return nuiS_data(o);
 }
 
-static NUIkey *nuiS_get(NUIstate *S, const char *s, size_t len, unsigned h) {
-    NUIkeyentry *o;
-    if (s == NULL || len == 0 || S->strt.hash == NULL) return NULL;
-    for (o = S->strt.hash[nui_lmod(h, S->strt.size)];
-         o != NULL;
-         o = o->next) {
+static NUIkey *nuiS_find(NUIkeyentry *o, const char *s, size_t len, unsigned h) {
+    for (; o != NULL; o = o->next) {
         size_t olen = nui_len((NUIdata*)o) - sizeof(NUIkeyentry);
         if (h == o->hash && len == olen &&
                 (memcmp(s, (char*)(o + 1), len+1) == 0))
@@ -628,29 +1284,104 @@ static NUIkey *nuiS_get(NUIstate *S, const char *s, size_t len, unsigned h) {
     return NULL;
 }
 
+static NUIkey *nuiS_get(NUIstate *S, const char *s, size_t len, unsigned h) {
+    NUIkeytable *kp = &S->strt;
+    NUIkey *key;
+    if (s == NULL || len == 0 || kp->hash == NULL) return NULL;
+    key = nuiS_find(kp->hash[nui_lmod(h, kp->size)], s, len, h);
+    if (key == NULL && kp->oldhash != NULL)
+        key = nuiS_find(kp->oldhash[nui_lmod(h, kp->oldsize)], s, len, h);
+    return key;
+}
+
 NUI_API NUIkey *nui_newkey(NUIstate *S, const char *s, size_t len) {
     unsigned hash = nui_calchash(S, s, len);
     NUIkey *key = nuiS_get(S, s, len, hash);
     return key ? key : nuiS_new(S, s, len, hash);
 }
 
+NUI_API NUIkey *nui_findkey(NUIstate *S, const char *s, size_t len)
+{ return nuiS_get(S, s, len, nui_calchash(S, s, len)); }
+
+static NUIkeyentry **nuiS_findlist(NUIkeyentry **list, NUIkeyentry *h) {
+    while (*list != NULL && *list != h)
+        list = &(*list)->next;
+    return list;
+}
+
 NUI_API void nui_delkey(NUIstate *S, NUIkey *key) {
+    NUIkeyentry *h = nuiS_header(key);
+    if (key == NULL || h->ref == 0 || --h->ref > 0 || h->ingc) return;
+    h->ingc = 1; /* free it in nuiS_sweep() if not revived */
+    h->nextgc = S->strt.gclist;
+    S->strt.gclist = h;
+}
+
+static void nuiS_free(NUIstate *S, NUIkeyentry *h) {
     NUIkeytable  *kp = &S->strt;
-    NUIkeyentry **list, *h = nuiS_header(key);
-    if (key == NULL || --h->ref > 0) return;
-    for (list = &kp->hash[nui_lmod(h->hash, kp->size)];
-            *list != NULL && *list != h; list = &(*list)->next)
-        ;
+    NUIkeyentry **list;
+    list = nuiS_findlist(&kp->hash[nui_lmod(h->hash, kp->size)], h);
+    if (*list == NULL && kp->oldhash != NULL)
+        list = nuiS_findlist(
+                &kp->oldhash[nui_lmod(h->hash, kp->oldsize)], h);
     if (*list == h) {
         *list = h->next;
         nui_deldata(S, (NUIdata*)h);
         --kp->nuse;
+        nuiS_rehash(S, NUI_REHASHSTEP);
+        if (kp->nuse < kp->size/4) /* shrink below low-water mark */
+            nuiS_resize(S, kp->size/2);
+    }
+}
+
+static void nuiS_sweep(NUIstate *S, size_t n) {
+    NUIkeytable *kp = &S->strt;
+    while (n-- > 0 && kp->oldgc != NULL) {
+        NUIkeyentry *h = kp->oldgc;
+        kp->oldgc = h->nextgc;
+        h->nextgc = NULL;
+        h->ingc = 0;
+        if (h->ref == 0) nuiS_free(S, h);
+    }
+    if (kp->oldgc == NULL) { /* keys get a whole tick to be revived */
+        kp->oldgc = kp->gclist;
+        kp->gclist = NULL;
+    }
+}
+
+static void nuiS_uncache(NUIkeycache *kc) {
+    if ((*kc->pprev = kc->next) != NULL)
+        kc->next->pprev = kc->pprev;
+    kc->S = NULL;
+    kc->key = NULL;
+    kc->next = NULL;
+    kc->pprev = NULL;
+}
+
+NUI_API NUIkey *nui_cachekey(NUIstate *S, NUIkeycache *kc, const char *s, size_t len) {
+    NUIkey *key = nui_newkey(S, s, len);
+    if (key == NULL) return NULL;
+    if (kc->S != NULL) {
+        NUIstate *oldS = kc->S;
+        NUIkey *oldkey = kc->key;
+        nuiS_uncache(kc);
+        nui_delkey(oldS, oldkey);
     }
+    kc->S = S;
+    kc->key = nui_usekey(key);
+    if ((kc->next = S->keycaches) != NULL)
+        kc->next->pprev = &kc->next;
+    kc->pprev = &S->keycaches;
+    S->keycaches = kc;
+    return key;
 }
 
 static void nuiS_close(NUIstate *S) {
     size_t i;
     NUIkeytable *kp = &S->strt;
+    while (S->keycaches != NULL)
+        nuiS_uncache(S->keycaches);
+    nuiS_rehash(S, kp->oldsize);
     for (i = 0; i < kp->size; ++i) {
         NUIkeyentry *h = kp->hash[i];
         kp->hash[i] = NULL;
@@ -676,20 +1407,14 @@ static size_t nuiH_hashsize(size_t len, size_t entrysize) {
     return newsize < len ? 0 : newsize;
 }
 
-static size_t nuiH_countsize(NUItable *t) {
-    size_t i, count = 0;
-    for (i = 0; i < t->size; ++i) {
-        NUIentry *e = &t->hash[i];
-        if (e->key != NULL) ++count;
-    }
-    return count;
-}
+#ifndef NUI_USE_SWISSTABLE
 
-static NUIentry *nuiH_newkey(NUIstate *S, NUItable *t, NUIkey *key) {
+/* chained scatter table with Brent's variation, as in Lua */
+
+#define nuiH_allocsize(size, esize) ((size)*(esize))
+
+static NUIentry *nuiH_hashnewkey(NUIstate *S, NUItable *t, NUIkey *key) {
     NUIentry *mp;
-    if (key == NULL ||
-            (t->size == 0 && nui_resizetable(S, t, NUI_MIN_HASHSIZE) == 0))
-        return NULL;
 redo:
     mp = nuiH_index(t->hash, nui_lmod(nuiS_hash(key), t->size)*t->entrysize);
     if (mp->key != 0) {
@@ -699,7 +1424,7 @@ redo:
             if (e->key == 0 && e->next == 0)  { f = e; break; }
         }
         if (f == NULL) {
-            if (nui_resizetable(S, t, nuiH_countsize(t)*2) == 0)
+            if (nui_resizetable(S, t, t->count*2) == 0)
                 return NULL;
             goto redo; /* return nuiH_newkey(t, entry); */
         }
@@ -710,7 +1435,7 @@ redo:
             while ((next = nuiH_index(othern, othern->next)) != mp)
                 othern = next;
             othern->next = nuiH_offset(f, othern);
-            *f = *mp;
+            memcpy(f, mp, t->entrysize); /* with payload */
             if (mp->next != 0)
             { f->next += nuiH_offset(mp, f); mp->next = 0; }
         }
@@ -721,72 +1446,368 @@ redo:
             mp->next = nuiH_offset(f, mp); mp = f;
         }
     }
-    mp->key = key;
-    nui_usekey(key);
-    return mp;
+    mp->key = key;
+    nui_usekey(key);
+    return mp;
+}
+
+static size_t nuiH_hashresize(NUIstate *S, NUItable *t, size_t len) {
+    size_t i, size = t->size*t->entrysize;
+    NUItable nt = *t;
+    if ((nt.size = nuiH_hashsize(len, nt.entrysize)) == 0) return 0;
+    nt.hash = (NUIentry*)nuiM_malloc(S, nt.lastfree = nt.size*nt.entrysize);
+    if (nt.hash == NULL) return 0;
+    memset(nt.hash, 0, nt.lastfree);
+    for (i = 0; i < size; i += nt.entrysize) {
+        NUIentry *e = nuiH_index(t->hash, i);
+        NUIentry *ne = e->key ? nuiH_hashnewkey(S, &nt, e->key) : NULL;
+        if (ne != NULL && nt.entrysize > sizeof(NUIentry))
+            memcpy(ne+1, e+1, nt.entrysize - sizeof(NUIentry));
+    }
+    if (t->hash != NULL) nuiM_free(S, t->hash, size);
+    *t = nt;
+    return t->size;
+}
+
+static NUIentry *nuiH_hashdel(NUItable *t, void *key) {
+    NUIentry *e = nuiH_index(t->hash,
+            nui_lmod(nuiS_hash(key), t->size)*t->entrysize), *prev = NULL;
+    while (e->key != key) {
+        if (e->next == 0) return NULL;
+        prev = e, e = nuiH_index(e, e->next);
+    }
+    if (prev != NULL) /* unlink from chain */
+        prev->next = e->next == 0 ? 0 : prev->next + e->next;
+    else if (e->next != 0) { /* main position, pull next one in */
+        NUIentry *n = nuiH_index(e, e->next);
+        memcpy(e, n, t->entrysize);
+        if (n->next != 0) e->next += nuiH_offset(n, e);
+        e = n;
+    }
+    e->key = NULL;
+    e->next = 0;
+    if ((size_t)nuiH_offset(e, t->hash) >= t->lastfree)
+        t->lastfree = nuiH_offset(e, t->hash) + t->entrysize;
+    return e;
+}
+
+static const NUIentry *nuiH_hashget(const NUItable *t, void *key) {
+    const NUIentry *e;
+    assert((t->size & (t->size - 1)) == 0);
+    e = nuiH_index(t->hash, nui_lmod(nuiS_hash(key), t->size)*t->entrysize);
+    while (1) {
+        ptrdiff_t next = e->next;
+        if (e->key == key) return e;
+        if (next == 0) return NULL;
+        e = nuiH_index(e, next);
+    }
+    return NULL;
+}
+
+#else /* NUI_USE_SWISSTABLE */
+
+/* open addressing with a control byte per slot, probed by groups of
+ * NUI_GROUPSIZE slots; control bytes follow the entries, with its first
+ * group mirrored at end so a group can be loaded at any slot */
+
+#define NUI_GROUPSIZE   16
+#define NUI_CTRL_EMPTY  0x80
+#define NUI_CTRL_DELETE 0xFE /* high bit set for empty or deleted */
+
+#define nuiH_allocsize(size, esize) ((size)*(esize) + \
+    ((size) <= NUI_LINEARSIZE ? 0 : (size) + NUI_GROUPSIZE))
+#define nuiH_ctrl(t)      ((unsigned char*)(t)->hash + (t)->size*(t)->entrysize)
+#define nuiH_h2(h)        ((unsigned char)((h) >> 25))
+#define nuiH_capacity(size) ((size) - ((size) + 7)/8) /* keep empties */
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+
+static unsigned nuiH_match(const unsigned char *g, unsigned char h2) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
+
+static unsigned nuiH_matchempty(const unsigned char *g) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)NUI_CTRL_EMPTY)));
+}
+
+static unsigned nuiH_matchfree(const unsigned char *g) {
+    return (unsigned)_mm_movemask_epi8(
+            _mm_loadu_si128((const __m128i*)g));
+}
+#else
+static unsigned nuiH_match(const unsigned char *g, unsigned char h2) {
+    unsigned i, mask = 0;
+    for (i = 0; i < NUI_GROUPSIZE; ++i)
+        if (g[i] == h2) mask |= 1u << i;
+    return mask;
+}
+
+static unsigned nuiH_matchempty(const unsigned char *g)
+{ return nuiH_match(g, NUI_CTRL_EMPTY); }
+
+static unsigned nuiH_matchfree(const unsigned char *g) {
+    unsigned i, mask = 0;
+    for (i = 0; i < NUI_GROUPSIZE; ++i)
+        if (g[i] & 0x80) mask |= 1u << i;
+    return mask;
+}
+#endif
+
+static int nuiH_firstbit(unsigned mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while ((mask & 1) == 0) mask >>= 1, ++i;
+    return i;
+#endif
+}
+
+static int nuiH_lastzeros(unsigned mask) {
+    int i = 0;
+    while ((mask & (1u << (NUI_GROUPSIZE-1-i))) == 0) ++i;
+    return i;
+}
+
+static void nuiH_setctrl(NUItable *t, size_t i, unsigned char c) {
+    unsigned char *ctrl = nuiH_ctrl(t);
+    for (; i < t->size + NUI_GROUPSIZE; i += t->size)
+        ctrl[i] = c; /* with mirrors at end */
+}
+
+static size_t nuiH_findfree(const NUItable *t, unsigned h) {
+    const unsigned char *ctrl = nuiH_ctrl(t);
+    size_t mask = t->size - 1, pos = h & mask, step = 0;
+    unsigned m;
+    while ((m = nuiH_matchfree(ctrl + pos)) == 0) {
+        step += NUI_GROUPSIZE;
+        pos = (pos + step) & mask;
+    }
+    return (pos + nuiH_firstbit(m)) & mask;
+}
+
+static NUIentry *nuiH_hashnewkey(NUIstate *S, NUItable *t, NUIkey *key) {
+    NUIentry *e;
+    size_t i;
+    if (t->lastfree == 0 && /* lastfree is count of free slots */
+            nui_resizetable(S, t, t->count*2 + 1) == 0)
+        return NULL;
+    i = nuiH_findfree(t, nuiS_hash(key));
+    if (nuiH_ctrl(t)[i] == NUI_CTRL_EMPTY) --t->lastfree;
+    nuiH_setctrl(t, i, nuiH_h2(nuiS_hash(key)));
+    e = nuiH_index(t->hash, i*t->entrysize);
+    e->next = 0;
+    e->key = key;
+    nui_usekey(key);
+    return e;
+}
+
+static size_t nuiH_hashresize(NUIstate *S, NUItable *t, size_t len) {
+    size_t i, count = t->count, size = t->size*t->entrysize;
+    NUItable nt = *t;
+    if ((nt.size = nuiH_hashsize(len, nt.entrysize)) != 0
+            && nuiH_capacity(nt.size) < len)
+        nt.size = nuiH_hashsize(nt.size*2, nt.entrysize);
+    if (nt.size == 0) return 0;
+    nt.hash = (NUIentry*)nuiM_malloc(S,
+            nuiH_allocsize(nt.size, nt.entrysize));
+    if (nt.hash == NULL) return 0;
+    memset(nt.hash, 0, nt.size*nt.entrysize);
+    memset(nuiH_ctrl(&nt), NUI_CTRL_EMPTY, nt.size + NUI_GROUPSIZE);
+    for (i = 0; i < size; i += nt.entrysize) {
+        NUIentry *e = nuiH_index(t->hash, i), *ne;
+        size_t j;
+        if (e->key == NULL) continue;
+        j = nuiH_findfree(&nt, nuiS_hash(e->key));
+        nuiH_setctrl(&nt, j, nuiH_h2(nuiS_hash(e->key)));
+        ne = nuiH_index(nt.hash, j*nt.entrysize);
+        memcpy(ne, e, nt.entrysize);
+        ne->next = 0;
+    }
+    nt.lastfree = nuiH_capacity(nt.size) - count;
+    if (t->hash != NULL)
+        nuiM_free(S, t->hash, nuiH_allocsize(t->size, t->entrysize));
+    *t = nt;
+    return t->size;
+}
+
+static const NUIentry *nuiH_hashget(const NUItable *t, void *key) {
+    const unsigned char *ctrl;
+    size_t mask, pos, step = 0;
+    unsigned h;
+    ctrl = nuiH_ctrl(t);
+    mask = t->size - 1;
+    pos = (h = nuiS_hash(key)) & mask;
+    while (1) {
+        unsigned m = nuiH_match(ctrl + pos, nuiH_h2(h));
+        while (m != 0) {
+            size_t i = (pos + nuiH_firstbit(m)) & mask;
+            const NUIentry *e = nuiH_index(t->hash, i*t->entrysize);
+            if (e->key == key) return e;
+            m &= m - 1;
+        }
+        if (nuiH_matchempty(ctrl + pos) != 0) return NULL;
+        step += NUI_GROUPSIZE;
+        pos = (pos + step) & mask;
+    }
+}
+
+static NUIentry *nuiH_hashdel(NUItable *t, void *key) {
+    NUIentry *e = (NUIentry*)nuiH_hashget(t, key);
+    const unsigned char *ctrl = nuiH_ctrl(t);
+    size_t i, mask = t->size - 1;
+    unsigned before, after;
+    if (e == NULL) return NULL;
+    i = nuiH_offset(e, t->hash) / t->entrysize;
+    before = nuiH_matchempty(ctrl + ((i - NUI_GROUPSIZE) & mask));
+    after = nuiH_matchempty(ctrl + i);
+    /* no probe saw a full group here: it can be empty again */
+    if (before && after && (nuiH_firstbit(after) +
+                nuiH_lastzeros(before)) < NUI_GROUPSIZE) {
+        nuiH_setctrl(t, i, NUI_CTRL_EMPTY);
+        ++t->lastfree;
+    }
+    else nuiH_setctrl(t, i, NUI_CTRL_DELETE);
+    e->key = NULL;
+    return e;
+}
+
+#endif /* NUI_USE_SWISSTABLE */
+
+/* tables up to NUI_LINEARSIZE entries are packed arrays without hash part,
+ * searched by comparing key pointers */
+
+#define nuiH_islinear(t) ((t)->size <= NUI_LINEARSIZE)
+
+static size_t nuiH_linearresize(NUIstate *S, NUItable *t, size_t len) {
+    size_t i, j = 0, size = t->size*t->entrysize;
+    NUItable nt = *t;
+    nt.size = 1;
+    while (nt.size < len) nt.size <<= 1;
+    nt.hash = (NUIentry*)nuiM_malloc(S, nt.size*nt.entrysize);
+    if (nt.hash == NULL) return 0;
+    memset(nt.hash, 0, nt.size*nt.entrysize);
+    for (i = 0; i < size; i += nt.entrysize) {
+        NUIentry *e = nuiH_index(t->hash, i);
+        if (e->key == NULL) continue;
+        memcpy(nuiH_index(nt.hash, j), e, nt.entrysize);
+        nuiH_index(nt.hash, j)->next = 0;
+        j += nt.entrysize;
+    }
+    nt.lastfree = 0;
+    if (t->hash != NULL)
+        nuiM_free(S, t->hash, nuiH_allocsize(t->size, t->entrysize));
+    *t = nt;
+    return t->size;
+}
+
+static NUIentry *nuiH_newkey(NUIstate *S, NUItable *t, NUIkey *key) {
+    size_t i, size = t->size*t->entrysize;
+    if (key == NULL) return NULL;
+    if (!nuiH_islinear(t))
+        return nuiH_hashnewkey(S, t, key);
+    for (i = 0; i < size; i += t->entrysize) {
+        NUIentry *e = nuiH_index(t->hash, i);
+        if (e->key == NULL) {
+            e->key = key;
+            nui_usekey(key);
+            return e;
+        }
+    }
+    if (nui_resizetable(S, t, t->size ? t->size*2 : NUI_LINEARSIZE) == 0)
+        return NULL;
+    return nuiH_newkey(S, t, key);
+}
+
+NUI_API size_t nui_resizetable(NUIstate *S, NUItable *t, size_t len) {
+    if (len == 0 && t->count == 0) { /* nothing to keep, drop storage */
+        nui_freetable(S, t);
+        return 0;
+    }
+    if (len < t->count) len = t->count;
+    if (len <= NUI_LINEARSIZE)
+        return nuiH_linearresize(S, t, len);
+    return nuiH_hashresize(S, t, len);
+}
+
+NUI_API int nui_deltable(NUIstate *S, NUItable *t, void *key) {
+    NUIentry *e = NULL;
+    if (key == NULL) return 0;
+    if (!nuiH_islinear(t))
+        e = nuiH_hashdel(t, key);
+    else if ((e = (NUIentry*)nui_gettable(t, key)) != NULL)
+        e->key = NULL;
+    if (e == NULL) return 0;
+    nui_delkey(S, (NUIkey*)key);
+    if (t->entrysize > sizeof(NUIentry))
+        memset(e+1, 0, t->entrysize - sizeof(NUIentry));
+    if (--t->count < t->size/4 && t->size > NUI_LINEARSIZE)
+        nui_resizetable(S, t, t->count*2); /* shrink, may fail */
+    return 1;
+}
+
+NUI_API const NUIentry *nui_gettable(const NUItable *t, void *key) {
+    size_t i, size = t->size*t->entrysize;
+    if (key == NULL) return NULL;
+    if (!nuiH_islinear(t))
+        return nuiH_hashget(t, key);
+    for (i = 0; i < size; i += t->entrysize) {
+        const NUIentry *e = nuiH_index(t->hash, i);
+        if (e->key == key) return e;
+    }
+    return NULL;
 }
 
 NUI_API void nui_inittable(NUItable *t, size_t entrysize) {
     if (entrysize < sizeof(NUIentry)) entrysize = sizeof(NUIentry);
     t->size      = 0;
-    t->entrysize = entrysize;
+    t->entrysize = (unsigned)entrysize;
+    t->count     = 0;
     t->lastfree  = 0;
     t->hash      = NULL;
 }
 
 NUI_API void nui_freetable(NUIstate *S, NUItable *t) {
-    size_t i;
-    for (i = 0; i < t->size; ++i) {
-        NUIentry *e = &t->hash[i];
-        if (e->key != NULL) nui_delkey(S, e->key);
+    size_t i, size = t->size*t->entrysize;
+    for (i = 0; i < size; i += t->entrysize) {
+        NUIentry *e = nuiH_index(t->hash, i);
+        if (e->key != NULL) nui_delkey(S, (NUIkey*)e->key);
     }
     if (t->hash != NULL)
-        nuiM_free(S, t->hash, t->size*t->entrysize);
+        nuiM_free(S, t->hash, nuiH_allocsize(t->size, t->entrysize));
     nui_inittable(t, t->entrysize);
 }
 
-NUI_API size_t nui_resizetable(NUIstate *S, NUItable *t, size_t len) {
+static void nuiH_cleartable(NUIstate *S, NUItable *t) {
     size_t i, size = t->size*t->entrysize;
-    NUItable nt = *t;
-    if ((nt.size = nuiH_hashsize(len, nt.entrysize)) == 0) return 0;
-    nt.hash = (NUIentry*)nuiM_malloc(S, nt.lastfree = nt.size*nt.entrysize);
-    memset(nt.hash, 0, nt.lastfree);
-    for (i = 0; i < size; i += nt.entrysize) {
+    if (!nuiH_islinear(t)) { nui_freetable(S, t); return; }
+    for (i = 0; i < size; i += t->entrysize) { /* keep packed array */
         NUIentry *e = nuiH_index(t->hash, i);
-        NUIentry *ne = nuiH_newkey(S, &nt, e->key);
-        if (ne != NULL && nt.entrysize > sizeof(NUIentry))
-            memcpy(ne+1, e+1, nt.entrysize - sizeof(NUIentry));
-    }
-    if (t->hash != NULL) nuiM_free(S, t->hash, size);
-    *t = nt;
-    return t->size;
-}
-
-NUI_API const NUIentry *nui_gettable(const NUItable *t, void *key) {
-    const NUIentry *e;
-    if (t->size == 0 || key == NULL) return NULL;
-    assert((t->size & (t->size - 1)) == 0);
-    e = nuiH_index(t->hash, nui_lmod(nuiS_hash(key), t->size)*t->entrysize);
-    while (1) {
-        ptrdiff_t next = e->next;
-        if (e->key == key) return e;
-        if (next == 0) return NULL;
-        e = nuiH_index(e, next);
+        if (e->key != NULL) nui_delkey(S, (NUIkey*)e->key);
     }
-    return NULL;
+    if (t->hash != NULL) memset(t->hash, 0, size);
+    t->count = 0;
 }
 
 NUI_API NUIentry *nui_settable(NUIstate *S, NUItable *t, void *key) {
     NUIentry *ret;
     if ((ret = (NUIentry*)nui_gettable(t, key)) == NULL
-            && (ret = nuiH_newkey(S, t, key)) != NULL
-            && t->entrysize > sizeof(NUIentry))
-        memset(ret+1, 0, t->entrysize - sizeof(NUIentry));
+            && (ret = nuiH_newkey(S, t, key)) != NULL) {
+        ++t->count;
+        if (t->entrysize > sizeof(NUIentry))
+            memset(ret+1, 0, t->entrysize - sizeof(NUIentry));
+    }
     return ret;
 }
 
 NUI_API int nui_nextentry(const NUItable *t, NUIentry **pentry) {
-    size_t i = *pentry ? nuiH_offset(pentry, t->hash) + t->entrysize : 0;
+    size_t i = *pentry ? nuiH_offset(*pentry, t->hash) + t->entrysize : 0;
     size_t size = t->size*t->entrysize;
     for (; i < size; i += t->entrysize) {
         NUIentry *e = nuiH_index(t->hash, i);
@@ -799,7 +1820,11 @@ NUI_API int nui_nextentry(const NUItable *t, NUIentry **pentry) {
 
 /* nui event handlers */
 
-typedef struct NUIhentry { NUIentry base; NUIhandlers *h; } NUIhentry;
+/* internal pins, unlike nui_release() always given back */
+#define nuiN_pin(n)   (++(n)->ref)
+#define nuiN_unpin(n) (--(n)->ref)
+
+typedef struct NUIhentry { NUIentry base; NUIlisteners *ls; } NUIhentry;
 
 NUI_API void nui_cancelevent(const NUIevent *evt)
 { if (evt->cancelable) ((NUIevent*)evt)->canceled = 1; }
@@ -807,103 +1832,546 @@ NUI_API void nui_cancelevent(const NUIevent *evt)
 NUI_API void nui_stopevent(const NUIevent *evt, int stopnow)
 { ((NUIevent*)evt)->stopnow = stopnow ? 1:0; ((NUIevent*)evt)->stopped = 1; }
 
-static void nuiE_dodefault(NUInode *n, NUIevent *evt) {
-    const NUIhentry *he = (NUIhentry*)nui_gettable(&n->handlers, evt->type);
-    NUIhandlers *hs;
-    if (he == NULL || (hs = he->h) == NULL)
-        return;
-    if (hs->u.handler && hs->level < NUI_MAX_EVENTLEVEL) {
-        ++hs->level;
-        hs->u.handler(hs->ud, n, evt);
-        --hs->level;
+static NUInodeext *nuiN_ext(NUInode *n);
+
+/* event types get dense ids on first listener; ids above 29 share bit 30
+ * of listenmask, so only their negative checks are inexact; bit 31 marks
+ * observed nodes, see nui_observe() */
+
+#define NUI_NOEVENTID    (~0u)
+#define NUI_OBSERVERBIT  (1u << 31)
+#define nuiE_typebit(id) (1u << ((id) < 30 ? (id) : 30))
+
+typedef struct NUIidentry {
+    NUIentry   base;
+    unsigned   id;
+    NUImergef *merge; /* for coalesced posted events */
+    void      *ud;
+} NUIidentry;
+
+static unsigned nuiE_typeid(NUIstate *S, NUIkey *type, int create) {
+    NUIidentry *ie = (NUIidentry*)nui_gettable(&S->evtypes, type);
+    if (ie == NULL && create) {
+        unsigned id = S->evtypes.count;
+        if ((ie = (NUIidentry*)nui_settable(S, &S->evtypes, type)) != NULL)
+            ie->id = id;
     }
+    return ie ? ie->id : NUI_NOEVENTID;
 }
 
-static void nuiE_sweepdead(NUIstate *S, NUIhandlers *hs) {
-    NUIhandlers **pp = &hs->next;
-    while (*pp != NULL) {
-        if (!(*pp)->dead)
-            pp = &(*pp)->next;
-        else {
-            NUIhandlers *next = (*pp)->next;
-            nui_pfree(&S->handlerpool, *pp);
-            *pp = next;
+NUI_API void nui_setmerge(NUIstate *S, NUIkey *type, NUImergef *f, void *ud) {
+    NUIidentry *ie;
+    if (nuiE_typeid(S, type, 1) == NUI_NOEVENTID) return;
+    ie = (NUIidentry*)nui_gettable(&S->evtypes, type);
+    ie->merge = f;
+    ie->ud    = ud;
+}
+
+static void nuiE_spread(NUInode *n, unsigned mask) {
+    NUInode *i = n; /* add mask to pathmask of subtree, iteratively */
+    while (i != NULL) {
+        NUInode *next = NULL;
+        if ((i->pathmask & mask) != mask) { /* else subtree has it */
+            i->pathmask |= mask;
+            next = nui_nextchild(i, NULL);
         }
+        while (next == NULL && i != n)
+            if ((next = nui_nextchild(i->parent, i)) == NULL)
+                i = i->parent;
+        i = next;
     }
 }
 
-static void nuiE_doevent(NUInode *n, NUIevent *evt, int capture) {
-    const NUIhentry *he = (NUIhentry*)nui_gettable(&n->handlers, evt->type);
-    NUIhandlers *hs, *p;
-    int havedead = 0;
-    if (he == NULL || (hs = he->h) == NULL || (p = hs->next) == NULL)
-        return;
-    assert(capture == 0 || capture == 1);
-    hs->running = 1;
-    while (p != NULL) {
-        NUIhandlers *next = p->next;
-        if (p->dead) havedead = 1;
-        else if (p->u.handler &&
-                p->capture == capture &&
-                p->level < NUI_MAX_EVENTLEVEL)
-        {
-            ++p->level;
-            p->u.handler(p->ud, n, evt);
-            --p->level;
+static void nuiE_unspread(NUInode *n, unsigned mask) {
+    NUInode *i = n; /* drop mask from pathmask of subtree, iteratively */
+    if (n->parent != NULL && (n->parent->pathmask & mask) == mask)
+        return; /* still inherited */
+    while (i != NULL) {
+        NUInode *next = NULL;
+        if (!(i->listenmask & mask) && (i->pathmask & mask)) {
+            i->pathmask &= ~mask; /* else kept by it, or already gone */
+            next = nui_nextchild(i, NULL);
         }
-        if (evt->stopnow) break;
-        p = next;
+        while (next == NULL && i != n)
+            if ((next = nui_nextchild(i->parent, i)) == NULL)
+                i = i->parent;
+        i = next;
     }
-    hs->running = 0;
-    if (havedead) nuiE_sweepdead(n->S, hs->next);
 }
 
-static void nuiE_capture(NUInode *n, NUIevent *evt) {
-    NUInode *parent = n->parent;
-    if (parent && !evt->stopped) {
-        nui_retain(parent);
-        nuiE_capture(parent, evt);
-        nuiE_doevent(parent, evt, 1);
-        nui_release(parent);
+static void nuiE_inherit(NUInode *n) {
+    if (n->parent != NULL)
+        nuiE_spread(n, n->parent->pathmask);
+}
+
+static NUIlisteners *nuiE_listeners(NUInode *n, NUIkey *type, unsigned id) {
+    const NUIhentry *he;
+    if (id == NUI_NOEVENTID || !(n->listenmask & nuiE_typebit(id)))
+        return NULL;
+    if (id < NUI_HOTEVENTS)
+        return n->ext->hot[id];
+    he = (NUIhentry*)nui_gettable(&n->ext->handlers, type);
+    return he ? he->ls : NULL;
+}
+
+static NUIlisteners *nuiE_newlisteners(NUInode *n, NUIkey *type) {
+    NUInodeext *ext = nuiN_ext(n);
+    NUIhentry *he = ext ? (NUIhentry*)nui_settable(n->S, &ext->handlers, type)
+        : NULL;
+    NUIlisteners *ls;
+    unsigned id;
+    if (he == NULL || (id = nuiE_typeid(n->S, type, 1)) == NUI_NOEVENTID)
+        return NULL;
+    if (he->ls != NULL) return he->ls;
+    ls = (NUIlisteners*)nui_palloc(n->S, &n->S->handlerpool);
+    if (ls == NULL) return NULL;
+    memset(ls, 0, sizeof(*ls));
+    ls->items = (NUIlistener*)nuiM_malloc(n->S, sizeof(NUIlistener));
+    if (ls->items == NULL) {
+        nui_pfree(&n->S->handlerpool, ls);
+        return NULL;
+    }
+    memset(ls->items, 0, sizeof(NUIlistener));
+    ls->count = ls->size = 1;
+    if (id < NUI_HOTEVENTS) {
+        ext->hot[id] = ls;
+        ++n->S->nlisteners[id];
     }
+    n->listenmask |= nuiE_typebit(id);
+    nuiE_spread(n, n->listenmask);
+    return he->ls = ls;
+}
+
+static NUIlistener *nuiE_insert(NUIstate *S, NUIlisteners *ls, unsigned i) {
+    if (ls->count == ls->size) {
+        NUIlistener *items = (NUIlistener*)nuiM_realloc(S, ls->items,
+                ls->size*2*sizeof(NUIlistener), ls->size*sizeof(NUIlistener));
+        if (items == NULL) return NULL;
+        ls->items = items;
+        ls->size *= 2;
+    }
+    memmove(&ls->items[i+1], &ls->items[i],
+            (ls->count++ - i)*sizeof(NUIlistener));
+    memset(&ls->items[i], 0, sizeof(NUIlistener));
+    return &ls->items[i];
 }
 
-static void nuiE_bubble(NUInode *n, NUIevent *evt) {
-    NUInode *parent = n->parent;
-    if (parent && !evt->stopped) {
-        nui_retain(parent);
-        nuiE_doevent(parent, evt, 0);
-        nuiE_bubble(parent, evt);
-        nui_release(parent);
+static void nuiE_remove(NUIlisteners *ls, unsigned i) {
+    if (i <= ls->ncapture) --ls->ncapture;
+    memmove(&ls->items[i], &ls->items[i+1],
+            (--ls->count - i)*sizeof(NUIlistener));
+}
+
+static void nuiE_sweepdead(NUIlisteners *ls) {
+    unsigned i, j, ncapture = ls->ncapture;
+    for (i = j = 1; i < ls->count; ++i) {
+        if (ls->items[i].dead) {
+            if (i <= ncapture) --ls->ncapture;
+        }
+        else if (j++ != i)
+            ls->items[j-1] = ls->items[i];
+    }
+    ls->count = j;
+    ls->havedead = 0;
+}
+
+static int nuiE_call(NUIlisteners *ls, unsigned i, NUInode *n, NUIevent *evt) {
+    NUIlistener *l = &ls->items[i];
+    if (!l->dead && l->handler && l->level < NUI_MAX_EVENTLEVEL) {
+        ++l->level;
+        l->handler(l->ud, n, evt);
+        return 1; /* items may move, caller decreases level */
+    }
+    return 0;
+}
+
+static void nuiE_dodefault(NUInode *n, NUIevent *evt, unsigned id) {
+    NUIlisteners *ls = nuiE_listeners(n, evt->type, id);
+    if (ls != NULL && nuiE_call(ls, 0, n, evt))
+        --ls->items[0].level;
+}
+
+static void nuiE_doevent(NUInode *n, NUIevent *evt, unsigned id, int capture) {
+    NUIlisteners *ls = nuiE_listeners(n, evt->type, id);
+    unsigned i, count;
+    if (ls == NULL || ls->count == 1)
+        return;
+    assert(capture == 0 || capture == 1);
+    ++ls->running;
+    /* handlers added while dispatching are not called; capture ones go
+     * before the bubble segment, so index bubble ones from ncapture */
+    count = capture ? ls->ncapture : ls->count - 1 - ls->ncapture;
+    for (i = 0; i < count && !evt->stopnow; ++i) {
+        if (capture && nuiE_call(ls, 1 + i, n, evt))
+            --ls->items[1 + i].level;
+        else if (!capture && nuiE_call(ls, 1 + ls->ncapture + i, n, evt))
+            --ls->items[1 + ls->ncapture + i].level;
     }
+    if (--ls->running == 0 && ls->havedead)
+        nuiE_sweepdead(ls);
+}
+
+static int nuiE_pushpath(NUIstate *S, NUInode *n) {
+    if (S->pathtop == S->pathsize) {
+        size_t size = S->pathsize ? S->pathsize*2 : NUI_MIN_PATHSIZE;
+        NUInode **path = (NUInode**)nuiM_realloc(S, S->path,
+                size*sizeof(NUInode*), S->pathsize*sizeof(NUInode*));
+        if (path == NULL) return 0;
+        S->path = path;
+        S->pathsize = size;
+    }
+    nuiN_pin(n);
+    S->path[S->pathtop++] = n;
+    return 1;
 }
 
 NUI_API int nui_emitevent(NUInode *n, NUIevent *evt) {
+    NUIstate *S;
+    size_t i, base, top;
+    unsigned id, bit;
     if (!n || !evt) return 1;
+    S = n->S;
     evt->node = n;
-    evt->emit_time = nui_time(n->S);
+    evt->emit_time = nui_time(S);
     evt->phase = NUI_CAPTURE;
     evt->canceled = 0;
     evt->stopnow = 0;
     evt->stopped = 0;
-    nuiE_capture(n, evt);
-    nui_retain(n);
-    nuiE_doevent(n, evt, 1);
+    /* path is target and its listening ancestors, fixed before dispatch;
+     * it may be moved by nested emits, so always index it from S */
+    if ((id = nuiE_typeid(S, evt->type, 0)) == NUI_NOEVENTID) {
+        evt->phase = 0; /* nobody ever listened */
+        return 1;
+    }
+    base = S->pathtop;
+    bit = nuiE_typebit(id);
+    if (!nuiE_pushpath(S, n)) return 1;
+    for (n = n->parent; n != NULL && (n->pathmask & bit); n = n->parent)
+        if ((n->listenmask & bit) && !nuiE_pushpath(S, n))
+            break;
+    top = S->pathtop;
+    for (i = top - 1; i > base && !evt->stopped; --i)
+        nuiE_doevent(S->path[i], evt, id, 1);
+    nuiE_doevent(S->path[base], evt, id, 1);
     if (!evt->stopped) {
         evt->phase = NUI_TARGET;
-        nuiE_doevent(n, evt, 0);
-        if (!evt->stopped && evt->bubbles) {
-            evt->phase = NUI_BUBBLE;
-            nuiE_bubble(n, evt);
-        }
+        nuiE_doevent(S->path[base], evt, id, 0);
+        evt->phase = NUI_BUBBLE;
+        for (i = base + 1; evt->bubbles && i < top && !evt->stopped; ++i)
+            nuiE_doevent(S->path[i], evt, id, 0);
     }
     evt->phase = 0;
     if (!evt->canceled)
-        nuiE_dodefault(n, evt);
-    nui_release(n);
+        nuiE_dodefault(S->path[base], evt, id);
+    assert(S->pathtop == top);
+    for (i = base; i < top; ++i)
+        nuiN_unpin(S->path[i]);
+    S->pathtop = base;
     return !evt->canceled;
 }
 
+/* posted events are emitted in nui_waitevents(); a coalesced one replaces
+ * or merges into the pending event of same node and type, if any */
+
+#define nuiE_posthash(n, type) \
+    ((size_t)(n) / sizeof(NUInode) ^ (size_t)nuiS_hash(type))
+
+static size_t *nuiE_postslot(NUIpostqueue *q, NUInode *n, NUIkey *type) {
+    size_t mask = q->indexsize - 1, i = nuiE_posthash(n, type) & mask;
+    while (q->index[i] != 0) {
+        NUIposted *p = &q->events[q->index[i] - 1];
+        if (p->node == n && p->evt.type == type) break;
+        i = (i + 1) & mask;
+    }
+    return &q->index[i];
+}
+
+static int nuiE_reindex(NUIstate *S, NUIpostqueue *q) {
+    size_t i, size = NUI_MIN_PATHSIZE;
+    while (size < q->ncoalesce*2 + 2) size <<= 1;
+    if (size != q->indexsize) {
+        size_t *index = (size_t*)nuiM_malloc(S, size*sizeof(size_t));
+        if (index == NULL) return 0;
+        nuiM_free(S, q->index, q->indexsize*sizeof(size_t));
+        q->index = index;
+        q->indexsize = size;
+    }
+    memset(q->index, 0, q->indexsize*sizeof(size_t));
+    for (i = 0; i < q->count; ++i) {
+        NUIposted *p = &q->events[i];
+        if (p->flags & NUI_COALESCE)
+            *nuiE_postslot(q, p->node, p->evt.type) = i + 1;
+    }
+    return 1;
+}
+
+static int nuiE_coalesce(NUIstate *S, NUIposted *p, NUIevent *evt) {
+    const NUIidentry *ie = (NUIidentry*)nui_gettable(&S->evtypes, evt->type);
+    if (ie && ie->merge && ie->merge(ie->ud, &p->evt, evt))
+        return 1; /* merged, data of evt kept by caller */
+    nui_freetable(S, &p->evt.data);
+    p->evt.data = evt->data;
+    p->evt.bubbles    = evt->bubbles;
+    p->evt.cancelable = evt->cancelable;
+    nui_inittable(&evt->data, evt->data.entrysize);
+    return 1;
+}
+
+NUI_API int nui_postevent(NUInode *n, NUIevent *evt, int flags) {
+    NUIstate *S;
+    NUIpostqueue *q;
+    NUIposted *p;
+    size_t *slot = NULL;
+    if (!n || !evt) return 0;
+    S = n->S, q = &S->posted;
+    if (flags & NUI_COALESCE) {
+        if ((q->ncoalesce + 1)*2 > q->indexsize && !nuiE_reindex(S, q))
+            return 0;
+        slot = nuiE_postslot(q, n, evt->type);
+        if (*slot != 0)
+            return nuiE_coalesce(S, &q->events[*slot - 1], evt);
+    }
+    if (q->count == q->size) {
+        size_t size = q->size ? q->size*2 : NUI_MIN_PATHSIZE;
+        p = (NUIposted*)nuiM_realloc(S, q->events,
+                size*sizeof(NUIposted), q->size*sizeof(NUIposted));
+        if (p == NULL) return 0;
+        q->events = p;
+        q->size = size;
+    }
+    p = &q->events[q->count++];
+    p->node  = n;
+    p->evt   = *evt; /* takes data of evt, leaves it empty */
+    p->flags = flags;
+    nuiN_pin(n);
+    nui_usekey(evt->type);
+    nui_inittable(&evt->data, evt->data.entrysize);
+    if (slot != NULL) *slot = q->count, ++q->ncoalesce;
+    return 1;
+}
+
+NUI_API void nui_flushevents(NUIstate *S) {
+    NUIpostqueue q = S->posted;
+    size_t i;
+    if (q.count == 0) return;
+    /* events posted while flushing wait for next flush */
+    S->posted.events = NULL;
+    S->posted.count = S->posted.size = 0;
+    S->posted.ncoalesce = 0;
+    if (q.index) memset(q.index, 0, q.indexsize*sizeof(size_t));
+    for (i = 0; i < q.count; ++i) {
+        NUIposted *p = &q.events[i];
+        nui_emitevent(p->node, &p->evt);
+        nui_freeevent(S, &p->evt);
+        nuiN_unpin(p->node);
+    }
+    if (S->posted.events == NULL) { /* reuse buffer */
+        S->posted.events = q.events;
+        S->posted.size = q.size;
+    }
+    else nuiM_free(S, q.events, q.size*sizeof(NUIposted));
+}
+
+/* observers get mutation records of their subtrees in batch, once per
+ * nui_waitevents(); observed nodes have the observer bit in pathmask */
+
+static int nuiE_observing(const NUInode *n) {
+    return n->S->observed.nobservers != 0
+        && (n->pathmask & NUI_OBSERVERBIT);
+}
+
+static void *nuiE_grow(NUIstate *S, void *p, size_t *size, size_t esize) {
+    size_t newsize = *size ? *size*2 : NUI_MIN_RECORDS;
+    p = nuiM_realloc(S, p, newsize*esize, *size*esize);
+    if (p != NULL) *size = newsize;
+    return p;
+}
+
+static void nuiE_record(int type, NUInode *target, NUInode *n, NUIkey *key) {
+    NUIstate *S = target->S;
+    NUIobserved *o = &S->observed;
+    NUIpending *r;
+    int extend;
+    if (!nuiE_observing(target)) return;
+    r = o->count ? &o->records[o->count - 1] : NULL;
+    extend = r && r->type == type && r->target == target && r->key == key;
+    if (n != NULL && o->ncount == o->nsize) {
+        NUInode **nodes = (NUInode**)nuiE_grow(S, o->nodes, &o->nsize,
+                sizeof(NUInode*));
+        if (nodes == NULL) return;
+        o->nodes = nodes;
+    }
+    if (!extend && o->count == o->size) {
+        NUIpending *records = (NUIpending*)nuiE_grow(S, o->records,
+                &o->size, sizeof(NUIpending));
+        if (records == NULL) return;
+        o->records = records;
+    }
+    if (!extend) { /* else nodes of last record are last in nodes */
+        r = &o->records[o->count++];
+        r->type   = type;
+        r->target = target;
+        r->key    = key;
+        r->first  = o->ncount;
+        r->count  = 0;
+        nuiN_pin(target);
+        if (key) nui_usekey(key);
+    }
+    if (n != NULL) {
+        o->nodes[o->ncount++] = n;
+        ++r->count;
+        nuiN_pin(n);
+    }
+}
+
+static int nuiE_contains(const NUInode *n, const NUInode *i) {
+    for (; i != NULL; i = i->parent)
+        if (i == n) return 1;
+    return 0;
+}
+
+static void nuiE_sweepobservers(NUIobserved *o) {
+    size_t i, j;
+    for (i = j = 0; i < o->nobservers; ++i)
+        if (o->observers[i].f != NULL)
+            o->observers[j++] = o->observers[i];
+    o->nobservers = j;
+    o->havedead = 0;
+}
+
+static size_t nuiE_collect(NUIobserved *o, const NUIobserver *ob,
+        const NUIpending *records, size_t count, NUInode **nodes) {
+    const NUInode *last = NULL;
+    size_t i, n = 0;
+    int inside = 0;
+    for (i = 0; i < count; ++i) {
+        const NUIpending *r = &records[i];
+        if (r->target != last) /* runs of records share target */
+            inside = nuiE_contains(ob->node, last = r->target);
+        if (inside) {
+            NUIrecord *out = &o->out[n++];
+            out->type   = r->type;
+            out->target = r->target;
+            out->key    = r->key;
+            out->nodes  = r->count ? nodes + r->first : NULL;
+            out->count  = r->count;
+        }
+    }
+    return n;
+}
+
+NUI_API void nui_flushrecords(NUIstate *S) {
+    NUIobserved *o = &S->observed;
+    NUIpending *records = o->records;
+    NUInode **nodes = o->nodes;
+    size_t count = o->count, size = o->size;
+    size_t ncount = o->ncount, nsize = o->nsize;
+    size_t i, nobservers = o->nobservers; /* not ones added in flush */
+    if (count == 0 || o->running) return;
+    if (o->outsize < count) {
+        NUIrecord *out = (NUIrecord*)nuiM_realloc(S, o->out,
+                count*sizeof(NUIrecord), o->outsize*sizeof(NUIrecord));
+        if (out == NULL) return;
+        o->out = out;
+        o->outsize = count;
+    }
+    /* mutations in observers are recorded for next flush */
+    o->records = NULL, o->count = o->size = 0;
+    o->nodes = NULL, o->ncount = o->nsize = 0;
+    ++o->running;
+    for (i = 0; i < nobservers; ++i) {
+        NUIobserver ob = o->observers[i]; /* observers may grow */
+        size_t n;
+        if (ob.f == NULL) continue;
+        if ((n = nuiE_collect(o, &ob, records, count, nodes)) != 0)
+            ob.f(ob.ud, ob.node, o->out, n);
+    }
+    if (--o->running == 0 && o->havedead)
+        nuiE_sweepobservers(o);
+    for (i = 0; i < count; ++i) {
+        nuiN_unpin(records[i].target);
+        if (records[i].key) nui_delkey(S, records[i].key);
+    }
+    for (i = 0; i < ncount; ++i)
+        nuiN_unpin(nodes[i]);
+    if (o->records == NULL) o->records = records, o->size = size;
+    else nuiM_free(S, records, size*sizeof(NUIpending));
+    if (o->nodes == NULL) o->nodes = nodes, o->nsize = nsize;
+    else nuiM_free(S, nodes, nsize*sizeof(NUInode*));
+}
+
+NUI_API int nui_observe(NUInode *n, NUIobserverf *f, void *ud) {
+    NUIstate *S;
+    NUIobserved *o;
+    NUIobserver *ob;
+    if (n == NULL || f == NULL) return 0;
+    S = n->S, o = &S->observed;
+    if (o->nobservers == o->obsize) {
+        NUIobserver *observers = (NUIobserver*)nuiE_grow(S, o->observers,
+                &o->obsize, sizeof(NUIobserver));
+        if (observers == NULL) return 0;
+        o->observers = observers;
+    }
+    ob = &o->observers[o->nobservers++];
+    ob->node = n;
+    ob->f    = f;
+    ob->ud   = ud;
+    nuiN_pin(n);
+    n->listenmask |= NUI_OBSERVERBIT;
+    nuiE_spread(n, NUI_OBSERVERBIT);
+    return 1;
+}
+
+NUI_API void nui_unobserve(NUInode *n, NUIobserverf *f, void *ud) {
+    NUIobserved *o;
+    size_t i, found = 0, others = 0;
+    if (n == NULL) return;
+    o = &n->S->observed;
+    for (i = 0; i < o->nobservers; ++i) {
+        NUIobserver *ob = &o->observers[i];
+        if (ob->node != n || ob->f == NULL)
+            continue;
+        if (!found && ob->f == f && ob->ud == ud)
+            found = i + 1;
+        else
+            ++others;
+    }
+    if (!found) return;
+    if (o->running) {
+        o->observers[found - 1].f = NULL;
+        o->havedead = 1;
+    } else {
+        memmove(&o->observers[found - 1], &o->observers[found],
+                (o->nobservers - found)*sizeof(NUIobserver));
+        --o->nobservers;
+    }
+    if (!others) {
+        n->listenmask &= ~NUI_OBSERVERBIT;
+        nuiE_unspread(n, NUI_OBSERVERBIT);
+    }
+    nuiN_unpin(n);
+}
+
+static void nuiE_close(NUIstate *S) {
+    NUIpostqueue *q = &S->posted;
+    NUIobserved *o = &S->observed;
+    size_t i;
+    for (i = 0; i < q->count; ++i) /* nodes are already deleted */
+        nui_freeevent(S, &q->events[i].evt);
+    nuiM_free(S, q->events, q->size*sizeof(NUIposted));
+    nuiM_free(S, q->index, q->indexsize*sizeof(size_t));
+    memset(q, 0, sizeof(*q));
+    for (i = 0; i < o->count; ++i)
+        if (o->records[i].key) nui_delkey(S, o->records[i].key);
+    nuiM_free(S, o->observers, o->obsize*sizeof(NUIobserver));
+    nuiM_free(S, o->records, o->size*sizeof(NUIpending));
+    nuiM_free(S, o->nodes, o->nsize*sizeof(NUInode*));
+    nuiM_free(S, o->out, o->outsize*sizeof(NUIrecord));
+    memset(o, 0, sizeof(*o));
+    nui_freetable(S, &S->evtypes);
+    nui_freetable(S, &S->mutation.data);
+}
+
 NUI_API void nui_initevent(NUIevent *evt, NUIkey *type, int bubbles, int cancelable) {
     memset(evt, 0, sizeof(*evt));
     evt->type = type;
@@ -930,69 +2398,54 @@ NUI_API int nui_eventstatus(const NUIevent *evt, int status) {
 }
 
 NUI_API void nui_defhandler(NUInode *n, NUIkey *type, NUIhandlerf *h, void *ud) {
-    NUIhentry *he = (NUIhentry*)nui_settable(n->S, &n->handlers, type);
-    NUIhandlers *hs = he ? he->h : NULL;
-    if (hs == NULL) {
-        hs = (NUIhandlers*)nui_palloc(n->S, &n->S->handlerpool);
-        memset(hs, 0, sizeof(*hs));
-        he->h = hs;
-    }
-    hs->u.handler = h;
-    hs->ud        = ud;
+    NUIlisteners *ls = nuiE_newlisteners(n, type);
+    if (ls == NULL) return;
+    ls->items[0].handler = h;
+    ls->items[0].ud      = ud;
 }
 
 NUI_API void nui_addhandler(NUInode *n, NUIkey *type, int capture, NUIhandlerf *h, void *ud) {
-    NUIhentry *he = (NUIhentry*)nui_settable(n->S, &n->handlers, type);
-    NUIhandlers **pp, *hs;
-    if (h == NULL || he == NULL) return;
-    if ((hs = he->h) == NULL) {
-        hs = (NUIhandlers*)nui_palloc(n->S, &n->S->handlerpool);
-        memset(hs, 0, sizeof(*hs));
-        he->h = hs;
-    }
-    pp = &hs->next;
-    while (*pp != NULL) pp = &(*pp)->next;
-    hs = *pp = (NUIhandlers*)nui_palloc(n->S, &n->S->handlerpool);
-    memset(hs, 0, sizeof(*hs));
-    hs->u.handler = h;
-    hs->ud        = ud;
-    hs->capture   = capture;
+    NUIlisteners *ls = h ? nuiE_newlisteners(n, type) : NULL;
+    NUIlistener *l;
+    if (ls == NULL) return;
+    l = nuiE_insert(n->S, ls, capture ? 1 + ls->ncapture : ls->count);
+    if (l == NULL) return;
+    if (capture) ++ls->ncapture;
+    l->handler = h;
+    l->ud      = ud;
 }
 
 NUI_API void nui_delhandler(NUInode *n, NUIkey *type, int capture, NUIhandlerf *h, void *ud) {
-    const NUIhentry *he = (NUIhentry*)nui_gettable(&n->handlers, type);
-    NUIhandlers **pp, *hs = he ? he->h : NULL;
-    if (hs == NULL) return;
-    pp = &hs->next; /* skip default handler */
-    while (*pp != NULL) {
-        NUIhandlers *cur = *pp, **next = &(*pp)->next;
-        if (cur->u.handler == h &&
-                cur->ud == ud &&
-                (cur->capture == 0) == (capture == 0))
+    NUIlisteners *ls = nuiE_listeners(n, type, nuiE_typeid(n->S, type, 0));
+    unsigned i, end;
+    if (ls == NULL) return;
+    i   = capture ? 1 : 1 + ls->ncapture; /* skip default handler */
+    end = capture ? 1 + ls->ncapture : ls->count;
+    for (; i < end; ++i) {
+        NUIlistener *l = &ls->items[i];
+        if (!l->dead && l->handler == h && l->ud == ud)
             break;
-        pp = next;
     }
-    if (*pp == NULL) return;
-    if (hs->running)
-        (*pp)->dead = 1;
-    else {
-        hs = *pp;
-        *pp = (*pp)->next;
-        nui_pfree(&n->S->handlerpool, hs);
-    }
-}
-
-void nuiE_clear(NUInode *n) {
-    NUIhentry *he = NULL;
-    while (nui_nextentry(&n->handlers, (NUIentry**)&he)) {
-        NUIhandlers *hs = he->h;
-        while (hs) {
-            NUIhandlers *next = hs->next;
-            nui_pfree(&n->S->handlerpool, hs);
-            hs = next;
-        }
+    if (i == end) return;
+    if (ls->running)
+        ls->items[i].dead = ls->havedead = 1;
+    else
+        nuiE_remove(ls, i);
+}
+
+static void nuiE_clear(NUInode *n) {
+    NUIentry *e = NULL;
+    unsigned id;
+    for (id = 0; id < NUI_HOTEVENTS; ++id)
+        if (n->ext->hot[id] != NULL) --n->S->nlisteners[id];
+    while (nui_nextentry(&n->ext->handlers, &e)) {
+        NUIlisteners *ls = ((NUIhentry*)e)->ls;
+        nuiM_free(n->S, ls->items, ls->size*sizeof(NUIlistener));
+        nui_pfree(&n->S->handlerpool, ls);
     }
-    nui_freetable(n->S, &n->handlers);
+    nui_freetable(n->S, &n->ext->handlers);
+    memset(n->ext->hot, 0, sizeof(n->ext->hot));
+    n->listenmask = 0; /* pathmask of subtree keeps it, harmless */
 }
 
 
@@ -1001,41 +2454,51 @@ void nuiE_clear(NUInode *n) {
 typedef struct NUIaentry { NUIentry base; NUIattr *attr; } NUIaentry;
 
 NUI_API NUIattr *nui_setattr(NUInode *n, NUIkey *key, NUIattr *attr) {
-    NUIaentry *ae = (NUIaentry*)nui_settable(n->S, &n->attrs, key);
+    NUInodeext *ext;
+    NUIaentry *ae;
     if (!attr) { nui_delattr(n, key); return NULL; }
-    return (NUIattr*)(!ae || ae->attr ? NULL : (ae->attr = attr));
+    ext = nuiN_ext(n);
+    ae = ext ? (NUIaentry*)nui_settable(n->S, &ext->attrs, key) : NULL;
+    if (!ae || ae->attr) return NULL;
+    nuiE_record(NUI_ATTRCHANGED, n, NULL, key);
+    return ae->attr = attr;
 }
 
 NUI_API NUIattr *nui_getattr(NUInode *n, NUIkey *key) {
-    const NUIaentry *ae = (NUIaentry*)nui_gettable(&n->attrs, key);
+    const NUIaentry *ae = n->ext ? (NUIaentry*)
+        nui_gettable(&n->ext->attrs, key) : NULL;
     return ae ? ae->attr : NULL;
 }
 
 NUI_API NUIattr *nui_delattr(NUInode *n, NUIkey *name) {
-    NUIaentry *ae = (NUIaentry*)nui_gettable(&n->attrs, name);
+    NUIaentry *ae = n->ext ? (NUIaentry*)
+        nui_gettable(&n->ext->attrs, name) : NULL;
     NUIattr *attr;
-    if (ae == NULL) return NULL;
+    if (ae == NULL || ae->attr == NULL) return NULL;
     attr = ae->attr;
     if (attr->del_attr != NULL)
         attr->del_attr(attr, n);
-    nui_delkey(n->S, (NUIkey*)ae->base.key);
-    ae->base.key = NULL;
-    ae->attr = NULL;
+    nui_deltable(n->S, &n->ext->attrs, name);
+    nuiE_record(NUI_ATTRCHANGED, n, NULL, name);
     return attr;
 }
 
 NUI_API NUIattr *nui_addattrhandler(NUInode *n, NUIattr *attr) {
-    NUIhandlers *hs = (NUIhandlers*)nui_palloc(n->S, &n->S->handlerpool);
+    NUInodeext *ext = nuiN_ext(n);
+    NUIhandlers *hs;
+    if (ext == NULL) return NULL;
+    hs = (NUIhandlers*)nui_palloc(n->S, &n->S->handlerpool);
     memset(hs, 0, sizeof(*hs));
-    hs->next = n->attrhandlers;
-    hs->u.attr = attr;
+    hs->next = ext->attrhandlers;
+    hs->attr = attr;
+    ext->attrhandlers = hs;
     return attr;
 }
 
 NUI_API NUIattr *nui_delattrhandler(NUInode *n, NUIattr *attr) {
-    NUIhandlers **pp = &n->attrhandlers;
-    while (*pp != NULL) {
-        if ((*pp)->u.attr != attr)
+    NUIhandlers **pp = n->ext ? &n->ext->attrhandlers : NULL;
+    while (pp != NULL && *pp != NULL) {
+        if ((*pp)->attr != attr)
             pp = &(*pp)->next;
         else {
             NUIhandlers *pnext = (*pp)->next;
@@ -1046,29 +2509,35 @@ NUI_API NUIattr *nui_delattrhandler(NUInode *n, NUIattr *attr) {
     return attr;
 }
 
+NUI_API int nui_hasattrhandler(const NUInode *n)
+{ return n->ext != NULL && n->ext->attrhandlers != NULL; }
+
 NUI_API int nui_set(NUInode *n, NUIkey *key, const char *v) {
     NUIattr *attr = nui_getattr(n, key);
-    NUIhandlers *hs = n->attrhandlers;
+    NUIhandlers *hs = n->ext ? n->ext->attrhandlers : NULL;
     if (attr && attr->set_attr && attr->set_attr(attr, n, key, v))
-        return 1;
+        goto changed;
     while (hs != NULL) {
-        attr = hs->u.attr;
+        attr = hs->attr;
         if (attr->set_attr && attr->set_attr(attr, n, key, v))
-            return 1;
+            goto changed;
         hs = hs->next;
     }
     return 0;
+changed:
+    nuiE_record(NUI_ATTRCHANGED, n, NULL, key);
+    return 1;
 }
 
-NUI_API NUIdata *nui_get(NUInode *n, NUIkey *key) {
+static NUIdata *nuiA_get(NUInode *n, NUIkey *key) {
     NUIattr *attr = nui_getattr(n, key);
     NUIdata *ret = NULL;
-    NUIhandlers *hs = n->attrhandlers;
+    NUIhandlers *hs = n->ext && key ? n->ext->attrhandlers : NULL;
     if (attr && attr->get_attr &&
             (ret = attr->get_attr(attr, n, key)) != NULL)
         return ret;
     while (hs != NULL) {
-        attr = hs->u.attr;
+        attr = hs->attr;
         if (attr->get_attr &&
                 (ret = attr->get_attr(attr, n, key)) != NULL)
             return ret;
@@ -1077,23 +2546,48 @@ NUI_API NUIdata *nui_get(NUInode *n, NUIkey *key) {
     return 0;
 }
 
+NUI_API NUIdata *nui_get(NUInode *n, NUIkey *key) {
+    NUIdata *ret = nuiA_get(n, key), *data;
+    if (ret == NULL || (((unsigned*)ret)[-1] & NUI_TRANSIENT) == 0)
+        return ret;
+    data = nui_newdata(n->S, (const char*)ret, nui_len(ret));
+    nui_deldata(n->S, ret);
+    return data;
+}
+
+NUI_API NUIdata *nui_gettransient(NUInode *n, NUIkey *key) {
+    NUIdata *ret = nuiA_get(n, key), *data;
+    if (ret == NULL || (((unsigned*)ret)[-1] & NUI_TRANSIENT) != 0)
+        return ret;
+    data = nui_newtransient(n->S, (const char*)ret, nui_len(ret));
+    nui_deldata(n->S, ret);
+    return data;
+}
+
 static void nuiA_clear(NUInode *n) {
+    NUInodeext *ext = n->ext;
     NUIhandlers *hs;
-    NUIaentry *ae = NULL;
-    while (nui_nextentry(&n->attrs, (NUIentry**)&ae))
-        if (ae->attr && ae->attr->del_attr)
-            ae->attr->del_attr(ae->attr, n);
-    nui_freetable(n->S, &n->attrs);
-    hs = n->attrhandlers;
+    while (ext->attrs.size != 0) {
+        NUItable attrs = ext->attrs; /* callbacks can't move entries */
+        NUIentry *e = NULL;
+        nui_inittable(&ext->attrs, attrs.entrysize);
+        while (nui_nextentry(&attrs, &e)) {
+            NUIattr *attr = ((NUIaentry*)e)->attr;
+            if (attr && attr->del_attr)
+                attr->del_attr(attr, n);
+        }
+        nui_freetable(n->S, &attrs);
+    }
+    hs = ext->attrhandlers;
     while (hs) {
         NUIhandlers *next = hs->next;
-        NUIattr *attr = hs->u.attr;
+        NUIattr *attr = hs->attr;
         if (attr->del_attr)
             attr->del_attr(attr, n);
-        nui_pfree(&n->S->handlerpool, n->attrhandlers);
+        nui_pfree(&n->S->handlerpool, hs);
         hs = next;
     }
-    n->attrhandlers = NULL;
+    ext->attrhandlers = NULL;
 }
 
 
@@ -1113,19 +2607,136 @@ NUI_API NUItype *nui_newtype(NUIstate *S, NUIkey *name, size_t size, size_t csiz
     t->name = name;
     t->type_size =  size;
     t->comp_size = csize;
-    if (csize < NUI_POOLSIZE/4)
-        nui_initpool(&t->comp_pool, csize);
+    nui_initpool(&t->comp_pool, (csize + sizeof(void*) - 1)
+            & ~(sizeof(void*) - 1));
     te->type = t;
     return t;
 }
 
+/* perfect hash over types, by hash and displace: keys of a bucket go to
+ * their multiplicative hash xored by the bucket's displacement, biggest
+ * buckets first; slots are a power of 2 so no division is needed */
+
+#define NUI_MAX_FREEZETRY 8
+#define nuiC_allocsize(th) \
+    ((th)->size*sizeof(NUItype*) + (th)->nbuckets*sizeof(unsigned))
+#define nuiC_bucket(th, h) ((h) & ((th)->nbuckets - 1))
+#define nuiC_slot(th, h, d) \
+    (((((h) * (th)->mult) & 0xFFFFFFFFu) >> (th)->shift) ^ (d))
+
+static NUItype *nuiC_getfrozen(const NUItypehash *th, NUIkey *name) {
+    unsigned h;
+    NUItype *t;
+    if (th->size == 0 || name == NULL) return NULL;
+    h = nuiS_hash(name);
+    t = th->slots[nuiC_slot(th, h, th->disp[nuiC_bucket(th, h)])];
+    return t && t->name == name ? t : NULL;
+}
+
+static void nuiC_unfreeze(NUIstate *S) {
+    NUItypehash *th = &S->frozen;
+    size_t i;
+    for (i = 0; i < th->size; ++i)
+        if (th->slots[i] != NULL) th->slots[i]->index = 0;
+    if (th->slots != NULL) nuiM_free(S, th->slots, nuiC_allocsize(th));
+    memset(th, 0, sizeof(*th));
+}
+
+static int nuiC_displace(NUItypehash *th, NUItype **group, size_t n) {
+    unsigned d;
+    size_t i, j;
+    for (d = 0; d < th->size; ++d) {
+        for (i = 0; i < n; ++i) {
+            size_t slot = nuiC_slot(th, nuiS_hash(group[i]->name), d);
+            if (th->slots[slot] != NULL) break;
+            th->slots[slot] = group[i];
+        }
+        if (i == n) {
+            th->disp[nuiC_bucket(th, nuiS_hash(group[0]->name))] = d;
+            return 1;
+        }
+        for (j = 0; j < i; ++j) /* undo this try */
+            th->slots[nuiC_slot(th, nuiS_hash(group[j]->name), d)] = NULL;
+    }
+    return 0;
+}
+
+static int nuiC_freeze(NUItypehash *th, NUItype **types, size_t n,
+        size_t *counts) {
+    size_t i, j;
+    memset(th->slots, 0, nuiC_allocsize(th));
+    memset(counts, 0, th->nbuckets*sizeof(size_t));
+    for (i = 0; i < n; ++i)
+        ++counts[nuiC_bucket(th, nuiS_hash(types[i]->name))];
+    for (i = 1; i < n; ++i) { /* biggest buckets first, grouped */
+        NUItype *t = types[i];
+        size_t b = nuiC_bucket(th, nuiS_hash(t->name));
+        for (j = i; j > 0; --j) {
+            size_t pb = nuiC_bucket(th, nuiS_hash(types[j-1]->name));
+            if (counts[pb] > counts[b] || (counts[pb] == counts[b] && pb <= b))
+                break;
+            types[j] = types[j-1];
+        }
+        types[j] = t;
+    }
+    for (i = 0; i < n; i += j) {
+        j = counts[nuiC_bucket(th, nuiS_hash(types[i]->name))];
+        if (!nuiC_displace(th, types + i, j)) return 0;
+    }
+    return 1;
+}
+
+NUI_API size_t nui_freezetypes(NUIstate *S) {
+    NUItypehash *th = &S->frozen;
+    NUItype **types = NULL;
+    NUIentry *e = NULL;
+    size_t *counts = NULL, i, n = S->types.count, ok = 0;
+    nuiC_unfreeze(S);
+    if (n == 0) return 0;
+    for (th->size = 2, th->shift = 31; th->size < n; th->size <<= 1)
+        --th->shift;
+    th->nbuckets = th->size/4 + 1;
+    while (th->nbuckets & (th->nbuckets - 1)) ++th->nbuckets;
+    th->slots = (NUItype**)nuiM_malloc(S, nuiC_allocsize(th));
+    types = (NUItype**)nuiM_malloc(S, n*sizeof(NUItype*));
+    counts = (size_t*)nuiM_malloc(S, th->nbuckets*sizeof(size_t));
+    if (th->slots != NULL && types != NULL && counts != NULL) {
+        th->disp = (unsigned*)(th->slots + th->size);
+        for (i = 0; nui_nextentry(&S->types, &e); ++i)
+            types[i] = ((NUItentry*)e)->type;
+        for (i = 0; !ok && i < NUI_MAX_FREEZETRY; ++i) {
+            th->mult = (0x9E3779B9u + (unsigned)i*0x6A09E667u) | 1;
+            ok = nuiC_freeze(th, types, n, counts);
+        }
+    }
+    if (counts) nuiM_free(S, counts, th->nbuckets*sizeof(size_t));
+    if (types)  nuiM_free(S, types, n*sizeof(NUItype*));
+    if (!ok) { /* no memory or same hashes, stay dynamic */
+        if (th->slots) nuiM_free(S, th->slots, nuiC_allocsize(th));
+        memset(th, 0, sizeof(*th));
+        return 0;
+    }
+    for (i = 0, n = 0; i < th->size; ++i)
+        if (th->slots[i] != NULL) th->slots[i]->index = ++n;
+    return n;
+}
+
+NUI_API NUItype *nui_nexttype(NUIstate *S, NUItype *curr) {
+    NUIentry *e = curr ? (NUIentry*)nui_gettable(&S->types, curr->name) : NULL;
+    return nui_nextentry(&S->types, &e) ? ((NUItentry*)e)->type : NULL;
+}
+
 NUI_API NUItype *nui_gettype(NUIstate *S, NUIkey *name) {
-    const NUItentry *te = (NUItentry*)nui_gettable(&S->types, name);
+    NUItype *t = nuiC_getfrozen(&S->frozen, name);
+    const NUItentry *te;
+    if (t != NULL) return t;
+    te = (NUItentry*)nui_gettable(&S->types, name);
     return te ? te->type : NULL;
 }
 
 NUI_API NUIcomp *nui_addcomp(NUInode *n, NUItype *t) {
-    NUIcentry *ce = n&&t ? (NUIcentry*)nui_settable(n->S, &n->comps, t->name)
+    NUInodeext *ext = n&&t ? nuiN_ext(n) : NULL;
+    NUIcentry *ce = ext ? (NUIcentry*)nui_settable(n->S, &ext->comps, t->name)
         : NULL;
     NUItype **depends;
     NUIcomp *comp;
@@ -1135,10 +2746,7 @@ NUI_API NUIcomp *nui_addcomp(NUInode *n, NUItype *t) {
     if (t->depends && (depends = t->depends(t, &dlen)) != NULL)
         for (i = 0; i < dlen; ++i)
             nui_addcomp(n, depends[i]);
-    if (t->comp_pool.size == 0)
-        comp = (NUIcomp*)nuiM_malloc(n->S, t->comp_size);
-    else
-        comp = (NUIcomp*)nui_palloc(n->S, &t->comp_pool);
+    comp = (NUIcomp*)nui_palloc(n->S, &t->comp_pool);
     memset(comp, 0, t->comp_size);
     if (t->new_comp && !t->new_comp(t, n, comp)) {
         nui_pfree(&t->comp_pool, comp);
@@ -1150,15 +2758,16 @@ NUI_API NUIcomp *nui_addcomp(NUInode *n, NUItype *t) {
 }
 
 NUI_API NUIcomp *nui_getcomp(NUInode *n, NUItype *t) {
-    const NUIcentry *ce = n ? (NUIcentry*)nui_gettable(&n->comps, t->name)
-        : NULL;
+    const NUIcentry *ce = n && t && n->ext ? (NUIcentry*)
+        nui_gettable(&n->ext->comps, t->name) : NULL;
     return ce ? ce->comp : NULL;
 }
 
 static void nuiC_close(NUIstate *S) {
-    NUItentry *te = NULL;
-    while (nui_nextentry(&S->types, (NUIentry**)&te)) {
-        NUItype *t = te->type;
+    NUIentry *e = NULL;
+    nuiC_unfreeze(S);
+    while (nui_nextentry(&S->types, &e)) {
+        NUItype *t = ((NUItentry*)e)->type;
         if (t->close != NULL)
             t->close(t, S);
         nui_freepool(S, &t->comp_pool);
@@ -1168,18 +2777,15 @@ static void nuiC_close(NUIstate *S) {
 }
 
 static void nuiC_clear(NUInode *n) {
-    NUIcentry *ce = NULL;
-    while (nui_nextentry(&n->comps, (NUIentry**)&ce)) {
-        NUIcomp *comp = ce->comp;
+    NUIentry *e = NULL;
+    while (nui_nextentry(&n->ext->comps, &e)) {
+        NUIcomp *comp = ((NUIcentry*)e)->comp;
         NUItype *type = comp->type;
         if (type->del_comp)
             type->del_comp(comp->type, n, comp);
-        if (type->comp_pool.size == 0)
-            nuiM_free(n->S, comp, type->comp_size);
-        else
-            nui_pfree(&type->comp_pool, comp);
+        nui_pfree(&type->comp_pool, comp);
     }
-    nui_freetable(n->S, &n->comps);
+    nui_freetable(n->S, &n->ext->comps);
 }
 
 
@@ -1187,6 +2793,19 @@ static void nuiC_clear(NUInode *n) {
 
 NUI_API NUIstate *nui_state(const NUInode *n) { return n ? n->S : NULL; }
 
+static NUInodeext *nuiN_ext(NUInode *n) {
+    NUInodeext *ext = n->ext;
+    if (ext != NULL) return ext;
+    ext = (NUInodeext*)nui_palloc(n->S, &n->S->extpool);
+    if (ext == NULL) return NULL;
+    nui_inittable(&ext->comps, sizeof(NUIcentry));
+    nui_inittable(&ext->attrs, sizeof(NUIaentry));
+    nui_inittable(&ext->handlers, sizeof(NUIhentry));
+    ext->attrhandlers = NULL;
+    memset(ext->hot, 0, sizeof(ext->hot));
+    return n->ext = ext;
+}
+
 NUI_API int nui_retain(NUInode *n) { return ++n->ref; } 
 NUI_API int nui_childcount(const NUInode *n) { return n->child_count; }
 
@@ -1233,35 +2852,64 @@ static void nuiN_detach(NUInode *n) {
         n->S->freenodes = NULL;
 }
 
+static NUIevent *nuiN_mutation(NUIstate *S, NUIevent *local, int id, int cancelable) {
+    NUIevent *evt = &S->mutation; /* nested emits get a local event */
+    if (S->mutating++) {
+        nui_initevent(local, S->builtins[id], 0, cancelable);
+        return local;
+    }
+    evt->type = S->builtins[id];
+    evt->bubbles = 0;
+    evt->cancelable = cancelable ? 1 : 0;
+    return evt;
+}
+
+static void nuiN_endmutation(NUIstate *S, NUIevent *evt) {
+    --S->mutating;
+    if (evt != &S->mutation) nui_freeevent(S, evt);
+    else nuiH_cleartable(S, &evt->data); /* no stale child for next one */
+}
+
 static int nuiN_emitevent(int id, int cancelable, NUInode *n, NUInode *parent) {
     NUIstate *S = n->S;
-    NUIevent evt;
-    int ret = 0;
-    nui_initevent(&evt, S->builtins[id], 0, cancelable);
-    if (id != NUI_add_child && id != NUI_remove_child)
-        ret = nui_emitevent(n, &evt);
-    else if (parent) {
+    NUIevent local, *evt;
+    int ret;
+    if (id != NUI_delete_node && parent != NULL)
+        nuiE_record(id == NUI_add_child ? NUI_ADDED : NUI_REMOVED,
+                parent, n, NULL);
+    if (S->nlisteners[id] == 0) return 1; /* nobody can cancel it */
+    if (id != NUI_delete_node && parent == NULL) return 0;
+    evt = nuiN_mutation(S, &local, id, cancelable);
+    if (id == NUI_delete_node)
+        ret = nui_emitevent(n, evt);
+    else {
         NUIkey *child = S->builtins[NUI_child];
-        ((NUIptrentry*)nui_settable(S, &evt.data, child))->value = n;
-        ret = nui_emitevent(parent, &evt);
+        ((NUIptrentry*)nui_settable(S, &evt->data, child))->value = n;
+        ret = nui_emitevent(parent, evt);
     }
-    nui_freeevent(S, &evt);
+    nuiN_endmutation(S, evt);
     return ret;
 }
 
 static void nuiN_childrenevents(NUIstate *S, int id, NUInode *parent) {
     NUIkey *child = S->builtins[NUI_child];
     NUInode *i, *next;
-    NUIevent evt;
+    NUIevent local, *evt;
     assert(id == NUI_add_child || id == NUI_remove_child);
     if (parent == NULL || parent->children == NULL) return;
-    nui_initevent(&evt, S->builtins[id], 0, 0);
+    if (nuiE_observing(parent))
+        for (i = nui_nextchild(parent, NULL); i != NULL;
+                i = nui_nextchild(parent, i))
+            nuiE_record(id == NUI_add_child ? NUI_ADDED : NUI_REMOVED,
+                    parent, i, NULL);
+    if (S->nlisteners[id] == 0) return;
+    evt = nuiN_mutation(S, &local, id, 0);
     for (i = nui_nextchild(parent, NULL); i != NULL; i = next) {
         next = nui_nextchild(parent, i);
-        ((NUIptrentry*)nui_settable(S, &evt.data, child))->value = i;
-        nui_emitevent(parent, &evt);
+        ((NUIptrentry*)nui_settable(S, &evt->data, child))->value = i;
+        nui_emitevent(parent, evt);
     }
-    nui_freeevent(S, &evt);
+    nuiN_endmutation(S, evt);
 }
 
 static void nuiN_cleanchildren(NUInode *n) {
@@ -1284,9 +2932,13 @@ static void nuiN_delete(NUInode *n, int freeself) {
     nuiN_detach(n);
     nuiN_cleanchildren(n);
     n->parent = NULL;
-    nuiA_clear(n);
-    nuiC_clear(n);
-    nuiE_clear(n);
+    if (n->ext != NULL) {
+        nuiA_clear(n);
+        nuiC_clear(n);
+        nuiE_clear(n);
+        nui_pfree(&n->S->extpool, n->ext);
+        n->ext = NULL;
+    }
     if (freeself) nui_pfree(&n->S->nodepool, n);
 }
 
@@ -1313,13 +2965,51 @@ NUI_API NUInode *nui_newnode(NUIstate *S) {
     memset(n, 0, sizeof(NUInode));
     n->ref = 0;
     n->S = S;
-    nui_inittable(&n->comps, sizeof(NUIcentry));
-    nui_inittable(&n->attrs, sizeof(NUIaentry));
-    nui_inittable(&n->handlers, sizeof(NUIhentry));
     nuiN_append(&S->freenodes, n);
     return n;
 }
 
+static NUInode *nuiN_initnode(NUIstate *S, void *obj, NUInode *prev) {
+    NUInode *n = (NUInode*)obj;
+    memset(n, 0, sizeof(NUInode));
+    n->S = S;
+    n->prev_sibling = prev;
+    if (prev) prev->next_sibling = n;
+    return n;
+}
+
+NUI_API size_t nui_newnodes(NUIstate *S, size_t count, NUInode **nodes) {
+    NUIpool *pool = &S->nodepool;
+    NUInode *prev = NULL;
+    size_t i = 0, j;
+    for (; i < count && pool->freed != NULL; ++i, --pool->nfree) {
+        void *obj = pool->freed;
+        pool->freed = *(void**)obj;
+        nodes[i] = prev = nuiN_initnode(S, obj, prev);
+    }
+    while (i < count) { /* carve the rest from new pages directly */
+        size_t keep = count - i;
+        char *obj = (char*)nuiM_newpage(S, pool, &keep);
+        if (obj == NULL) break;
+        for (j = 0; j < keep; ++j, obj += pool->size)
+            nodes[i++] = prev = nuiN_initnode(S, obj, prev);
+    }
+    if (i == 0) return 0;
+    nodes[0]->prev_sibling = prev; /* close the ring and splice it */
+    prev->next_sibling = nodes[0];
+    if (S->freenodes == NULL)
+        S->freenodes = nodes[0];
+    else
+        nuiN_merge(S->freenodes->prev_sibling, nodes[0]);
+    return i;
+}
+
+NUI_API void nui_releasenodes(NUInode **nodes, size_t count) {
+    size_t i;
+    for (i = 0; i < count; ++i)
+        if (nodes[i] != NULL) nui_release(nodes[i]);
+}
+
 NUI_API int nui_release(NUInode *n) {
     NUInode *root = &n->S->base;
     if (n == root || (n->parent && n->parent != root)) return 1;
@@ -1335,6 +3025,7 @@ NUI_API void nui_setparent(NUInode *n, NUInode *parent) {
     if (parent == n) { n->parent = NULL; return; }
     nuiN_append(&parent->children, n);
     ++parent->child_count;
+    nuiE_inherit(n);
     nuiN_emitevent(NUI_add_child, 0, n, parent);
 }
 
@@ -1357,6 +3048,7 @@ NUI_API void nui_setchildren(NUInode *n, NUInode *newnode) {
         next = nui_nextsibling(newnode, i);
         i->parent = n;
         ++n->child_count;
+        nuiE_inherit(i);
     }
     nuiN_childrenevents(n->S, NUI_add_child, n);
 }
@@ -1373,6 +3065,7 @@ NUI_API void nui_append(NUInode *n, NUInode *newnode) {
     else {
         nuiN_insert(n->next_sibling, newnode);
         ++n->parent->child_count;
+        nuiE_inherit(newnode);
         nuiN_emitevent(NUI_add_child, 0, newnode, n->parent);
     }
 }
@@ -1391,6 +3084,7 @@ NUI_API void nui_insert(NUInode *n, NUInode *newnode) {
         if (n->parent->children == n)
             n->parent->children = newnode;
         ++n->parent->child_count;
+        nuiE_inherit(newnode);
         nuiN_emitevent(NUI_add_child, 0, newnode, n->parent);
     }
 }
@@ -1636,17 +3330,44 @@ static NUItime nuiT_gettimeout(NUIstate *S, NUItime current) {
 #   include <mach/mach_time.h>
 # endif
 # include <sys/select.h>
+# if defined(NUI_USE_HUGEPAGE) && defined(__linux__)
+#   include <sys/mman.h>
+# endif
+#endif
+
+#ifndef nui_makeseed
+# define nui_makeseed() ((unsigned)time(NULL))
 #endif
 
 NUI_API NUIparams *nui_getparams(NUIstate *S)
 { return S->params; }
 
+static unsigned nuiD_makeseed(NUIstate *S) {
+    char buff[3*sizeof(size_t)];
+    unsigned h = nui_makeseed();
+    size_t p = (size_t)S;
+    memcpy(buff, &p, sizeof(p));
+    p = (size_t)&h; /* ASLR makes stack addresses random */
+    memcpy(buff + sizeof(p), &p, sizeof(p));
+    p = (size_t)clock();
+    memcpy(buff + 2*sizeof(p), &p, sizeof(p));
+    return nuiS_hashbytes(buff, sizeof(buff), h);
+}
+
 static void *nuiD_alloc(NUIparams *params, void *p, size_t nsize, size_t osize) {
     (void)params, (void)osize;
     if (nsize == 0) {
         free(p);
         return NULL;
     }
+#if defined(NUI_USE_HUGEPAGE) && defined(__linux__)
+    if (p == NULL && nsize == NUI_HUGEPAGESIZE) {
+        if (posix_memalign(&p, NUI_HUGEPAGESIZE, nsize) != 0)
+            return NULL;
+        madvise(p, nsize, MADV_HUGEPAGE);
+        return p;
+    }
+#endif
     return realloc(p, nsize);
 }
 
@@ -1706,6 +3427,7 @@ static int nuiD_wait(NUIparams *params, NUItime time) {
 
 NUI_API NUIstate *nui_newstate(NUIparams *params) {
     NUIstate *S;
+    int i;
     if (!params->alloc) params->alloc = nuiD_alloc;
     if (!params->nomem) params->nomem = nuiD_nomem;
     if (!params->time)  params->time  = nuiD_time;
@@ -1716,19 +3438,24 @@ NUI_API NUIstate *nui_newstate(NUIparams *params) {
     if (S == NULL) return NULL;
     memset(S, 0, sizeof(NUIstate));
     S->params = params;
+    S->strt.seed = nuiD_makeseed(S);
+    nuiM_account(S, sizeof(NUIstate), 0);
     S->base.S = S;
     S->base.next_sibling = S->base.prev_sibling = &S->base;
-    nui_inittable(&S->base.attrs, sizeof(NUIaentry));
-    nui_inittable(&S->base.comps, sizeof(NUIcentry));
-    nui_inittable(&S->base.handlers, sizeof(NUIhentry));
     nui_initpool(&S->timers.pool, sizeof(NUItimer));
-    nui_initpool(&S->handlerpool, sizeof(NUIhandlers));
+    nui_initpool(&S->handlerpool, sizeof(NUIlisteners) > sizeof(NUIhandlers)
+            ? sizeof(NUIlisteners) : sizeof(NUIhandlers));
     nui_initpool(&S->nodepool, sizeof(NUInode));
-    nui_initpool(&S->smallpool, NUI_SMALLSIZE);
+    nui_initpool(&S->extpool, sizeof(NUInodeext));
+    nuiM_initpools(S);
     nui_inittable(&S->types, sizeof(NUItentry));
+    nui_inittable(&S->evtypes, sizeof(NUIidentry));
 #define X(str) S->builtins[NUI_##str] = nui_usekey(NUI_(str));
     nui_builtinkeys(X)
 #undef  X
+    for (i = NUI_add_child; i <= NUI_delete_node; ++i) /* ids are hot */
+        nuiE_typeid(S, S->builtins[i], 1);
+    nui_inittable(&S->mutation.data, sizeof(NUIptrentry));
     return S;
 }
 
@@ -1747,14 +3474,91 @@ NUI_API void nui_close(NUIstate *S) {
         S->params->close(S->params);
     nuiC_close(S);
     nuiT_cleartimers(S);
+    nuiE_close(S);
     nuiS_close(S);
+    nuiM_arenareset(S, &S->transient, 0);
+    nuiM_free(S, S->path, S->pathsize*sizeof(NUInode*));
     nui_freepool(S, &S->handlerpool);
     nui_freepool(S, &S->nodepool);
-    nui_freepool(S, &S->smallpool);
+    nui_freepool(S, &S->extpool);
+    nuiM_freepools(S);
     params->alloc(S->params, S, 0, sizeof(NUIstate));
     params->S = NULL;
 }
 
+static size_t nuiM_freebytes(NUIstate *S) {
+    NUIentry *e = NULL;
+    size_t i, bytes = S->nodepool.nfree*S->nodepool.size
+        + S->extpool.nfree*S->extpool.size
+        + S->handlerpool.nfree*S->handlerpool.size
+        + S->timers.pool.nfree*S->timers.pool.size;
+    while (nui_nextentry(&S->types, &e)) {
+        NUIpool *pool = &((NUItentry*)e)->type->comp_pool;
+        bytes += pool->nfree*pool->size;
+    }
+    for (i = 0; i < NUI_SIZECLASSES; ++i)
+        bytes += S->smallpools[i].nfree*S->smallpools[i].size;
+    return bytes;
+}
+
+NUI_API size_t nui_trim(NUIstate *S) {
+    NUIentry *e = NULL;
+    size_t i, released = nui_trimpool(S, &S->nodepool)
+        + nui_trimpool(S, &S->extpool)
+        + nui_trimpool(S, &S->handlerpool)
+        + nui_trimpool(S, &S->timers.pool);
+    while (nui_nextentry(&S->types, &e))
+        released += nui_trimpool(S, &((NUItentry*)e)->type->comp_pool);
+    for (i = 0; i < NUI_SIZECLASSES; ++i) /* small pools at last */
+        released += nui_trimpool(S, &S->smallpools[i]);
+    return released;
+}
+
+static size_t nuiM_nodebytes(const NUInode *n) {
+    const NUInodeext *ext = n->ext;
+    return ext == NULL ? 0
+        : nuiH_allocsize(ext->comps.size, ext->comps.entrysize)
+        + nuiH_allocsize(ext->attrs.size, ext->attrs.entrysize)
+        + nuiH_allocsize(ext->handlers.size, ext->handlers.entrysize);
+}
+
+NUI_API void nui_memstats(NUIstate *S, NUImemstats *ms) {
+    NUIkeytable *kp = &S->strt;
+    NUInode *n, *f;
+    NUItype *t = NULL;
+    NUIpage *b;
+    size_t i;
+    memset(ms, 0, sizeof(NUImemstats));
+    nui_poolstats(&S->nodepool, &ms->nodes);
+    nui_poolstats(&S->extpool, &ms->exts);
+    nui_poolstats(&S->handlerpool, &ms->handlers);
+    nui_poolstats(&S->timers.pool, &ms->timers);
+    for (i = 0; i < NUI_SIZECLASSES; ++i)
+        nuiM_addstats(&ms->small, &S->smallpools[i]);
+    while ((t = nui_nexttype(S, t)) != NULL)
+        nuiM_addstats(&ms->comps, &t->comp_pool);
+    ms->keys = kp->nuse;
+    ms->keybytes = (kp->size + kp->oldsize)*sizeof(NUIkeyentry*);
+    for (i = 0; i < kp->size + kp->oldsize; ++i) {
+        NUIkeyentry *o = i < kp->size ? kp->hash[i] : kp->oldhash[i-kp->size];
+        for (; o != NULL; o = o->next)
+            ms->keybytes += sizeof(unsigned)
+                + nui_len((NUIdata*)o) + 1;
+    }
+    for (n = &S->base; n != NULL; n = nui_nextleaf(&S->base, n))
+        ms->tablebytes += nuiM_nodebytes(n);
+    for (f = S->freenodes; f != NULL; f = nui_nextsibling(S->freenodes, f))
+        for (n = f; n != NULL; n = nui_nextleaf(f, n))
+            ms->tablebytes += nuiM_nodebytes(n);
+    for (b = S->transient.blocks; b != NULL; b = b->next)
+        ms->transient += b->size;
+    ms->total = S->memtotal;
+    ms->peak  = S->mempeak;
+}
+
+NUI_API void nui_resetpeak(NUIstate *S)
+{ S->mempeak = S->memtotal; }
+
 NUI_API int nui_waitevents(NUIstate *S, NUItime waittime) {
     int ret;
     if (nuiT_hastimers(S)) {
@@ -1763,11 +3567,27 @@ NUI_API int nui_waitevents(NUIstate *S, NUItime waittime) {
         timerwait = nuiT_gettimeout(S, current);
         if (timerwait < waittime) waittime = timerwait;
     }
-    if (S->base.child_count == 0 && !nuiT_hastimers(S))
+    if ((S->base.child_count == 0 && !nuiT_hastimers(S))
+            || S->posted.count != 0 || S->observed.count != 0)
         waittime = 0;
     ret = S->params->wait(S->params, waittime);
+    nui_flushevents(S);
+    nui_flushrecords(S);
     S->freenodes = nuiN_sweepdead(S->freenodes);
-    return !(ret || nuiT_hastimers(S) || S->base.child_count != 0);
+    nuiM_arenareset(S, &S->transient, 1);
+    nuiS_sweep(S, NUI_GCSTEP);
+    nuiS_rehash(S, NUI_REHASHTICK);
+    if (S->params->trim_threshold != 0) {
+        size_t freebytes = nuiM_freebytes(S);
+        if (freebytes < S->trimfree) S->trimfree = freebytes;
+        /* trim again only when free bytes grew by threshold since then */
+        if (freebytes - S->trimfree > S->params->trim_threshold) {
+            nui_trim(S);
+            S->trimfree = nuiM_freebytes(S);
+        }
+    }
+    return !(ret || nuiT_hastimers(S) || S->base.child_count != 0
+            || S->posted.count != 0 || S->observed.count != 0);
 }
 
 NUI_API int nui_loop(NUIstate *S) {
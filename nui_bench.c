@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#define NUI_IMPLEMENTATION
+#define NUI_USE_STATICKEY
+#include "nui.h"
+
+static size_t alloc_count;
+static size_t free_count;
+
+static void *count_alloc(NUIparams *params, void *ptr, size_t nsize, size_t osize) {
+    (void)params, (void)osize;
+    if (nsize == 0) {
+        ++free_count;
+        free(ptr);
+        return NULL;
+    }
+    ++alloc_count;
+    return realloc(ptr, nsize);
+}
+
+static void reset_counts(void) { alloc_count = free_count = 0; }
+
+static double elapsed_ms(clock_t start)
+{ return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC; }
+
+static void on_click(void *ud, NUInode *n, const NUIevent *evt)
+{ (void)ud, (void)n, (void)evt; }
+
+static void bench_nodes(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUItype *t = nui_newtype(S, NUI_(bench), 0, 0);
+    NUIattr attr = { NULL };
+    NUInode *parent = nui_newnode(S);
+    clock_t start;
+    size_t allocs, frees;
+    int i;
+    nui_setparent(parent, nui_rootnode(S));
+    reset_counts();
+    start = clock();
+    for (i = 0; i < count; ++i) {
+        NUInode *n = nui_newnode(S);
+        NUIdata *text = nui_newfstring(S,
+                "node #%d: a label text that is longer than the smallest"
+                " size classes, to stress the string allocations", i);
+        nui_addcomp(n, t);
+        nui_setattr(n, NUI_(text), &attr);
+        nui_setattr(n, NUI_(style), &attr);
+        nui_addhandler(n, NUI_(click), 0, on_click, NULL);
+        nui_setparent(n, parent);
+        nui_deldata(S, text);
+    }
+    allocs = alloc_count, frees = free_count;
+    printf("nodes:\t\t%d nodes, %.2f ms, %.3f mallocs/node, %.3f frees/node\n",
+            count, elapsed_ms(start),
+            (double)allocs/count, (double)frees/count);
+    nui_close(S);
+}
+
+static void bench_leaves(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *parent = nui_newnode(S), *n;
+    NUImemstats ms;
+    clock_t start;
+    int i, visited = 0;
+    nui_setparent(parent, nui_rootnode(S));
+    for (i = 0; i < count; ++i)
+        nui_setparent(nui_newnode(S), parent);
+    nui_memstats(S, &ms);
+    start = clock();
+    for (n = parent; n != NULL; n = nui_nextleaf(parent, n))
+        ++visited;
+    printf("leaves:\t\t%d nodes, %.3f bytes/node, traverse %.2f ms\n",
+            visited, (double)(ms.nodes.bytes + ms.exts.bytes
+                + ms.tablebytes)/count, elapsed_ms(start));
+    nui_close(S);
+}
+
+static double build_ms(int count, int observed) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *parent = nui_newnode(S), *n = NULL;
+    clock_t start;
+    int i;
+    nui_setparent(parent, nui_rootnode(S));
+    if (observed)
+        nui_addhandler(parent, NUI_(add_child), 0, on_click, NULL);
+    reset_counts();
+    start = clock();
+    for (i = 0; i < count; ++i) {
+        NUInode *child = nui_newnode(S);
+        if (i % 16 == 0 || n == NULL)
+            nui_setparent(n = child, parent);
+        else
+            nui_append(n, child);
+    }
+    for (n = nui_nextchild(parent, NULL); n != NULL; n = nui_nextchild(parent, NULL))
+        nui_detach(n);
+    nui_close(S);
+    return elapsed_ms(start);
+}
+
+static void bench_build(int count) {
+    double quiet = build_ms(count, 0);
+    size_t allocs = alloc_count;
+    double observed = build_ms(count, 1);
+    printf("build:		%d nodes, %.2f ms unobserved (%.3f mallocs/node),"
+            " %.2f ms observed (%.3f)\n", count, quiet,
+            (double)allocs/count, observed, (double)alloc_count/count);
+}
+
+static double newnodes_ms(int count, int bulk, int warm) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode **nodes = (NUInode**)malloc(count*sizeof(NUInode*));
+    clock_t start;
+    double ms;
+    int i;
+    if (warm) { /* pages are touched and nodes back in free list */
+        nui_newnodes(S, count, nodes);
+        nui_waitevents(S, 0);
+    }
+    start = clock();
+    if (bulk)
+        nui_newnodes(S, count, nodes);
+    else for (i = 0; i < count; ++i)
+        nodes[i] = nui_newnode(S);
+    ms = elapsed_ms(start);
+    free(nodes);
+    nui_close(S);
+    return ms;
+}
+
+static void bench_newnodes(int count) {
+    printf("newnodes:\t%d nodes, fresh pages %.2f ms one by one, %.2f ms bulk,"
+            " pooled %.2f ms one by one, %.2f ms bulk\n", count,
+            newnodes_ms(count, 0, 0), newnodes_ms(count, 1, 0),
+            newnodes_ms(count, 0, 1), newnodes_ms(count, 1, 1));
+}
+
+static void bench_keys(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *n = nui_newnode(S);
+    NUIattr attr = { NULL };
+    clock_t start;
+    double interned;
+    int i, found = 0;
+    nui_setattr(n, NUI_(style.margin), &attr);
+    start = clock();
+    for (i = 0; i < count; ++i)
+        found += nui_getattr(n, NUI_KEY(S, style.margin)) != NULL;
+    interned = elapsed_ms(start);
+    start = clock();
+    for (i = 0; i < count; ++i)
+        found += nui_getattr(n, NUI_(style.margin)) != NULL;
+    printf("keys:\t\t%d getattr, %.2f ms interned, %.2f ms cached (%d)\n",
+            count, interned, elapsed_ms(start), found);
+    nui_close(S);
+}
+
+static void bench_tables(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode **nodes = (NUInode**)malloc(count*sizeof(NUInode*));
+    NUIkey *attrs[16], *events[4];
+    NUItype *types[3];
+    NUIattr attr = { NULL };
+    clock_t start;
+    double insert;
+    size_t found = 0;
+    char buff[32];
+    int i, j, round;
+    for (i = 0; i < 16; ++i) {
+        sprintf(buff, "style.attr%d", i);
+        attrs[i] = nui_usekey(nui_newkey(S, buff, strlen(buff)));
+    }
+    for (i = 0; i < 4; ++i) {
+        sprintf(buff, "event%d", i);
+        events[i] = nui_usekey(nui_newkey(S, buff, strlen(buff)));
+    }
+    for (i = 0; i < 3; ++i) {
+        sprintf(buff, "type%d", i);
+        types[i] = nui_newtype(S, nui_newkey(S, buff, strlen(buff)), 0, 0);
+    }
+    nui_newnodes(S, count, nodes);
+    start = clock();
+    for (i = 0; i < count; ++i) {
+        for (j = 0; j < 8; ++j)
+            nui_setattr(nodes[i], attrs[j], &attr);
+        for (j = 0; j < 4; ++j)
+            nui_addhandler(nodes[i], events[j], 0, on_click, NULL);
+        for (j = 0; j < 3; ++j)
+            nui_addcomp(nodes[i], types[j]);
+    }
+    insert = elapsed_ms(start);
+    start = clock();
+    for (round = 0; round < 10; ++round)
+        for (i = 0; i < count; ++i) {
+            for (j = 0; j < 16; ++j) /* half of them missing */
+                found += nui_getattr(nodes[i], attrs[j]) != NULL;
+            for (j = 0; j < 3; ++j)
+                found += nui_getcomp(nodes[i], types[j]) != NULL;
+        }
+    printf("tables (%s):\t%d nodes, insert %.2f ms, lookup %.2f ms (%d)\n",
+#ifdef NUI_USE_SWISSTABLE
+            "swiss",
+#else
+            "chain",
+#endif
+            count, insert, elapsed_ms(start), (int)found);
+    free(nodes);
+    nui_close(S);
+}
+
+static void on_count(void *ud, NUInode *n, const NUIevent *evt)
+{ (void)n, (void)evt; ++*(size_t*)ud; }
+
+static void bench_dispatch(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *n = nui_rootnode(S);
+    NUIevent evt;
+    clock_t start;
+    size_t called = 0;
+    int i, j;
+    for (i = 0; i < 8; ++i) {
+        NUInode *child = nui_newnode(S);
+        nui_setparent(child, n);
+        n = child;
+        for (j = 0; j < 16; ++j) {
+            nui_addhandler(n, NUI_(ping), j & 1, on_count, &called);
+            nui_addhandler(n, NUI_(pong), j & 1, on_click, NULL);
+        }
+    }
+    nui_initevent(&evt, NUI_(ping), 1, 0);
+    start = clock();
+    for (i = 0; i < count; ++i)
+        nui_emitevent(n, &evt);
+    printf("dispatch:\t%d events, 8 levels, %.2f ms (%d handlers called)\n",
+            count, elapsed_ms(start), (int)called);
+    for (i = 0; i < 56; ++i) { /* deep path, listeners at top only */
+        NUInode *child = nui_newnode(S);
+        nui_setparent(child, n);
+        n = child;
+    }
+    called = 0;
+    start = clock();
+    for (i = 0; i < count; ++i)
+        nui_emitevent(n, &evt);
+    printf("dispatch:\t%d events, 64 levels, %.2f ms (%d handlers called)\n",
+            count, elapsed_ms(start), (int)called);
+    nui_freeevent(S, &evt);
+    called = 0; /* raw samples, coalesced per frame of 1000 */
+    start = clock();
+    for (i = 0; i < count; ++i) {
+        nui_initevent(&evt, NUI_(ping), 1, 0);
+        nui_postevent(n, &evt, NUI_COALESCE);
+        nui_freeevent(S, &evt);
+        if (i % 1000 == 999) nui_flushevents(S);
+    }
+    printf("post:\t\t%d events, 64 levels, %.2f ms (%d handlers called)\n",
+            count, elapsed_ms(start), (int)called);
+    nui_close(S);
+}
+
+static void on_records(void *ud, NUInode *n, const NUIrecord *records, size_t count)
+{ (void)n, (void)records; *(size_t*)ud += count; }
+
+static double swap_ms(int count, int rounds, int observe) {
+    NUIparams params = { NULL };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *a = nui_newnode(S), *b = nui_newnode(S);
+    size_t batches = 0;
+    clock_t start;
+    int i;
+    nui_setparent(a, nui_rootnode(S));
+    nui_setparent(b, nui_rootnode(S));
+    for (i = 0; i < count; ++i)
+        nui_setparent(nui_newnode(S), b);
+    if (observe)
+        nui_observe(nui_rootnode(S), on_records, &batches);
+    else {
+        nui_addhandler(a, NUI_(add_child), 0, on_click, NULL);
+        nui_addhandler(a, NUI_(remove_child), 0, on_click, NULL);
+        nui_addhandler(b, NUI_(add_child), 0, on_click, NULL);
+        nui_addhandler(b, NUI_(remove_child), 0, on_click, NULL);
+    }
+    start = clock();
+    for (i = 0; i < rounds; ++i) {
+        nui_setchildren(a, nui_nextchild(b, NULL));
+        nui_setchildren(b, nui_nextchild(a, NULL));
+        nui_flushrecords(S);
+    }
+    nui_close(S);
+    return elapsed_ms(start);
+}
+
+static void bench_observe(int count) {
+    double events = swap_ms(count, 100, 0);
+    double records = swap_ms(count, 100, 1);
+    printf("observe:\t%d children swapped 200 times, %.2f ms events,"
+            " %.2f ms records\n", count, events, records);
+}
+
+static void bench_types(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIkey *names[64];
+    clock_t start;
+    double dynamic;
+    size_t found = 0;
+    char buff[32];
+    int i, j;
+    for (i = 0; i < 64; ++i) {
+        sprintf(buff, "widget.type%d", i);
+        names[i] = nui_newkey(S, buff, strlen(buff));
+        nui_newtype(S, names[i], 0, 0);
+    }
+    start = clock();
+    for (i = 0; i < count; ++i)
+        for (j = 0; j < 64; ++j)
+            found += nui_gettype(S, names[j]) != NULL;
+    dynamic = elapsed_ms(start);
+    nui_freezetypes(S);
+    start = clock();
+    for (i = 0; i < count; ++i)
+        for (j = 0; j < 64; ++j)
+            found += nui_gettype(S, names[j]) != NULL;
+    printf("types:\t\t%d gettype, %.2f ms dynamic, %.2f ms frozen (%d)\n",
+            count*64, dynamic, elapsed_ms(start), (int)found);
+    nui_close(S);
+}
+
+static void bench_bigtable(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIkey **keys = (NUIkey**)malloc(count*sizeof(NUIkey*));
+    NUItable t;
+    clock_t start;
+    double insert;
+    size_t found = 0;
+    char buff[32];
+    int i, round;
+    for (i = 0; i < count; ++i) {
+        sprintf(buff, "key%d", i);
+        keys[i] = nui_usekey(nui_newkey(S, buff, strlen(buff)));
+    }
+    nui_inittable(&t, sizeof(NUIptrentry));
+    start = clock();
+    for (i = 0; i < count/2; ++i)
+        ((NUIptrentry*)nui_settable(S, &t, keys[i]))->value = keys[i];
+    insert = elapsed_ms(start);
+    start = clock();
+    for (round = 0; round < 10; ++round)
+        for (i = 0; i < count; ++i) /* half of them missing */
+            found += nui_gettable(&t, keys[i]) != NULL;
+    printf("bigtable (%s):\t%d keys, insert %.2f ms, lookup %.2f ms (%d)\n",
+#ifdef NUI_USE_SWISSTABLE
+            "swiss",
+#else
+            "chain",
+#endif
+            count/2, insert, elapsed_ms(start), (int)found);
+    nui_freetable(S, &t);
+    free(keys);
+    nui_close(S);
+}
+
+static void bench_churn(int count) {
+    NUIparams params = { count_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *n = nui_newnode(S);
+    NUIkey *keys[64];
+    NUIattr attr = { NULL };
+    NUImemstats ms;
+    clock_t start;
+    size_t found = 0;
+    char buff[32];
+    int i, j;
+    for (i = 0; i < 64; ++i) {
+        sprintf(buff, "style.attr%d", i);
+        keys[i] = nui_usekey(nui_newkey(S, buff, strlen(buff)));
+    }
+    start = clock();
+    for (i = 0; i < count; ++i) {
+        for (j = 0; j < 64; ++j)
+            nui_setattr(n, keys[j], &attr);
+        for (j = 0; j < 62; ++j)
+            nui_delattr(n, keys[j]);
+        for (j = 0; j < 64; ++j)
+            found += nui_getattr(n, keys[j]) != NULL;
+    }
+    nui_memstats(S, &ms);
+    printf("churn:\t\t%d rounds, %.2f ms, %d table bytes left (%d)\n",
+            count, elapsed_ms(start), (int)ms.tablebytes, (int)found);
+    nui_close(S);
+}
+
+static int cmp_unsigned(const void *a, const void *b) {
+    unsigned x = *(const unsigned*)a, y = *(const unsigned*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_hashcorpus(const char *name, char **keys, size_t count) {
+    unsigned *hashes = (unsigned*)malloc(count*sizeof(unsigned));
+    size_t *buckets, size = 1, i, collisions = 0, maxchain = 0, probes = 0;
+    unsigned sum = 0;
+    clock_t start;
+    int round;
+    while (size < count) size <<= 1;
+    buckets = (size_t*)calloc(size, sizeof(size_t));
+    for (i = 0; i < count; ++i) {
+        hashes[i] = nuiS_hashbytes(keys[i], strlen(keys[i]), 0x9e3779b9u);
+        if (++buckets[hashes[i] & (size-1)] > maxchain)
+            maxchain = buckets[hashes[i] & (size-1)];
+    }
+    for (i = 0; i < size; ++i)
+        probes += buckets[i]*(buckets[i]+1)/2;
+    qsort(hashes, count, sizeof(unsigned), cmp_unsigned);
+    for (i = 1; i < count; ++i)
+        if (hashes[i] == hashes[i-1]) ++collisions;
+    start = clock();
+    for (round = 0; round < 20; ++round)
+        for (i = 0; i < count; ++i)
+            sum += nuiS_hashbytes(keys[i], strlen(keys[i]), sum);
+    printf("hash %-8s\t%d keys, %d full collisions, max chain %d,"
+            " %.3f probes/key, %.1f ns/key (%x)\n",
+            name, (int)count, (int)collisions, (int)maxchain,
+            (double)probes/count, elapsed_ms(start)*1e6/count/20, sum & 0xF);
+    free(buckets);
+    free(hashes);
+}
+
+static void bench_hash(void) {
+    static const char *props[] = { "margin", "padding", "border", "inset",
+        "outline", "scroll-margin", "scroll-padding", "border-radius" };
+    static const char *sides[] = { "left", "right", "top", "bottom",
+        "inline-start", "inline-end", "block-start", "block-end" };
+    static const char *states[] = { "", "hover.", "active.", "focus.",
+        "disabled.", "selected.", "checked.", "pressed." };
+    char **keys = (char**)malloc(100000*sizeof(char*)), buff[128];
+    size_t i, j, k, count = 0;
+    printf("hash algorithm:\t%s\n", NUI_HASH == NUI_HASH_SAMPLE ?
+            "sample" : "mix64");
+    for (i = 0; i < 8; ++i)
+        for (j = 0; j < 8; ++j)
+            for (k = 0; k < 8; ++k) {
+                sprintf(buff, "%sstyle.%s.%s", states[i], props[j], sides[k]);
+                keys[count++] = strcpy((char*)malloc(strlen(buff)+1), buff);
+            }
+    bench_hashcorpus("style", keys, count);
+    for (i = 0; i < count; ++i) free(keys[i]);
+    for (count = 0; count < 100000; ++count) {
+        sprintf(buff, "data-row-%05d-column-%03d-cell-value",
+                (int)count/100, (int)count%100);
+        keys[count] = strcpy((char*)malloc(strlen(buff)+1), buff);
+    }
+    bench_hashcorpus("cells", keys, count);
+    for (i = 0; i < count; ++i) free(keys[i]);
+    for (count = 0; count < 100000; ++count) {
+        sprintf(buff, "on_list_view_item_selection_changed_handler_%d",
+                (int)count);
+        keys[count] = strcpy((char*)malloc(strlen(buff)+1), buff);
+    }
+    bench_hashcorpus("handlers", keys, count);
+    for (i = 0; i < count; ++i) free(keys[i]);
+    free(keys);
+}
+
+int main(void) {
+    bench_nodes(100000);
+    bench_leaves(1000000);
+    bench_build(1000000);
+    bench_newnodes(1000000);
+    bench_hash();
+    bench_keys(1000000);
+    bench_tables(100000);
+    bench_dispatch(100000);
+    bench_observe(10000);
+    bench_types(100000);
+    bench_bigtable(200000);
+    bench_churn(100000);
+    return 0;
+}
+/* cc: flags+='-O2' */
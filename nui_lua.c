@@ -38,10 +38,17 @@ static NUIkey *ln_testkey(NUIstate *S, lua_State *L, int idx) {
     return nui_newkey(S, s, len);
 }
 
+static NUIkey *ln_findkey(NUIstate *S, lua_State *L, int idx) {
+    size_t len;
+    const char *s = luaL_checklstring(L, idx, &len);
+    return nui_findkey(S, s, len);
+}
+
 static NUItype *ln_checktype(NUIstate *S, lua_State *L, int idx) {
-    NUIkey *key = ln_testkey(S, L, idx);
-    if (key == NULL) return (NUItype*)lbind_check(L, idx, &lbT_Type);
-    return nui_gettype(S, key);
+    size_t len;
+    const char *s = lua_tolstring(L, idx, &len);
+    if (s == NULL) return (NUItype*)lbind_check(L, idx, &lbT_Type);
+    return nui_gettype(S, nui_findkey(S, s, len));
 }
 
 
@@ -437,8 +444,7 @@ static int Ltype_setenv(lua_State *L) {
 static int Ltype_get(lua_State *L) {
     NUIstate *S = ln_checkstate(L, 1);
     LNUIlua *ls = ln_statefromS(S);
-    NUIkey *key = ln_testkey(S, L, 2);
-    NUItype *t = nui_gettype(S, key);
+    NUItype *t = ln_checktype(S, L, 2);
     if (t == NULL) return 0;
     lua_rawgeti(L, LUA_REGISTRYINDEX, ls->objects);
     if (lua_rawgetp(L, -1, t) == LUA_TNIL)
@@ -480,6 +486,12 @@ static int Lnode_getcomp(lua_State *L) {
     return 1;
 }
 
+static int Ltype_freeze(lua_State *L) {
+    NUIstate *S = ln_checkstate(L, 1);
+    lua_pushinteger(L, (lua_Integer)nui_freezetypes(S));
+    return 1;
+}
+
 static void open_type(lua_State *L) {
     luaL_Reg libs[] = {
         { "__call", Ltype_setenv },
@@ -488,6 +500,7 @@ static void open_type(lua_State *L) {
         ENTRY(new),
         ENTRY(delete),
         ENTRY(get),
+        ENTRY(freeze),
 #undef  ENTRY
         { NULL, NULL }
     };
@@ -517,7 +530,7 @@ static NUIdata *ln_getattr(NUIattr *attr, NUInode *node, NUIkey *key) {
     else {
         size_t len;
         const char *s = lua_tolstring(L, -1, &len);
-        if (s) ret = nui_newdata(lattr->ls->S, s, len);
+        if (s) ret = nui_newtransient(lattr->ls->S, s, len);
     }
     lua_pop(L, 1);
     return ret;
@@ -582,19 +595,19 @@ static LNUIattr *ln_newattr(lua_State *L, NUIstate *S, int idx) {
     lattr->ls = ls;
     if ((type = lua_type(L, idx++)) != LUA_TNIL) {
         if (type != LUA_TFUNCTION) goto not_func;
-        lua_pushvalue(L, 3);
+        lua_pushvalue(L, idx - 1);
         lattr->getattr_ref = luaL_ref(L, LUA_REGISTRYINDEX);
         lattr->base.get_attr = ln_getattr;
     }
     if ((type = lua_type(L, idx++)) != LUA_TNIL) {
         if (type != LUA_TFUNCTION) goto not_func;
-        lua_pushvalue(L, idx);
+        lua_pushvalue(L, idx - 1);
         lattr->setattr_ref = luaL_ref(L, LUA_REGISTRYINDEX);
         lattr->base.set_attr = ln_setattr;
     }
     if ((type = lua_type(L, idx++)) != LUA_TNIL) {
         if (type != LUA_TFUNCTION) goto not_func;
-        lua_pushvalue(L, idx);
+        lua_pushvalue(L, idx - 1);
         lattr->delattr_ref = luaL_ref(L, LUA_REGISTRYINDEX);
         lattr->base.del_attr = ln_delattr;
     }
@@ -605,7 +618,7 @@ static LNUIattr *ln_newattr(lua_State *L, NUIstate *S, int idx) {
 
 not_func:
     lua_pushfstring(L, "function expected, got %s", lua_typename(L, type));
-    luaL_argerror(L, idx, lua_tostring(L, -1));
+    luaL_argerror(L, idx - 1, lua_tostring(L, -1));
     return NULL;
 }
 
@@ -670,7 +683,7 @@ static int Lnode_setattr(lua_State *L) {
 
 static int Lnode_getattr(lua_State *L) {
     NUInode *n = (NUInode*)lbind_check(L, 1, &lbT_Node);
-    NUIkey *key = ln_checkkey(nui_state(n), L, 2);
+    NUIkey *key = ln_findkey(nui_state(n), L, 2);
     LNUIattr *lattr = (LNUIattr*)nui_getattr(n, key);
     if (lattr == NULL) return 0;
     if (!lbind_retrieve(L, lattr))
@@ -680,7 +693,7 @@ static int Lnode_getattr(lua_State *L) {
 
 static int Lnode_delattr(lua_State *L) {
     NUInode *n = (NUInode*)lbind_check(L, 1, &lbT_Node);
-    NUIkey *key = ln_checkkey(nui_state(n), L, 2);
+    NUIkey *key = ln_findkey(nui_state(n), L, 2);
     NUIattr *attr = nui_delattr(n, key);
     if (attr == NULL) return 0;
     if (!lbind_retrieve(L, attr))
@@ -706,15 +719,21 @@ static int Lnode_delattrhandler(lua_State *L) {
 
 static int Lnode_hashf(lua_State *L) {
     NUInode *n = (NUInode*)lbind_check(L, 1, &lbT_Node);
-    NUIkey *key = ln_checkkey(nui_state(n), L, 2);
+    NUIkey *key;
     if (lua_gettop(L) == 2) {
-        NUIdata *ret = nui_get(n, key);
-        if (!ret) return -1;
+        NUIdata *ret;
+        key = ln_findkey(nui_state(n), L, 2); /* unknown key has no attr */
+        if (key == NULL && nui_hasattrhandler(n)) /* but handlers may */
+            key = ln_checkkey(nui_state(n), L, 2);
+        if (key == NULL || (ret = nui_gettransient(n, key)) == NULL)
+            return -1;
         lua_pushlstring(L, (char*)ret, nui_len(ret));
+        nui_deldata(nui_state(n), ret);
         return 1;
     }
     else {
         const char *v = luaL_checkstring(L, 3);
+        key = ln_checkkey(nui_state(n), L, 2);
         if (!nui_set(n, key, v)) return -1;
         return 0;
     }
@@ -805,26 +824,32 @@ static int Levent_delete(lua_State *L) {
     return 0;
 }
 
+static int ln_isnodekey(LNUIlua *ls, NUIkey *key) {
+    int i;
+    for (i = 1; i < LNUI_KEY_MAX; ++i)
+        if (key == ls->keys[i]) return 1;
+    return 0;
+}
+
 static int Levent_hashf(lua_State *L) {
     LNUIevent *levt = lbind_check(L, 1, &lbT_Event);
     LNUIlua *ls = levt->ls;
     NUIstate *S = ls->S;
     NUIptrentry *e;
-    int i, isnode = 0;
     NUIkey *key;
     if (levt->current == NULL)
         luaL_argerror(L, 1, "expired event object");
-    key = ln_checkkey(S, L, 2);
-    e = (NUIptrentry*)nui_gettable(nui_eventdata(levt->current), key);
-    for (i = 1; i < LNUI_KEY_MAX; ++i)
-        if (key == ls->keys[i]) { isnode = 1; break; }
     if (lua_gettop(L) == 2) {
-        if (e->value == NULL) return 0;
-        if (isnode) return ln_pushnode(L, e->value);
+        key = ln_findkey(S, L, 2);
+        e = (NUIptrentry*)nui_gettable(nui_eventdata(levt->current), key);
+        if (e == NULL || e->value == NULL) return 0;
+        if (ln_isnodekey(ls, key)) return ln_pushnode(L, e->value);
         lua_pushlstring(L, e->value, nui_len((NUIdata*)e->value));
         return 1;
     }
-    if (isnode) {
+    key = ln_checkkey(S, L, 2);
+    e = (NUIptrentry*)nui_settable(S, nui_eventdata(levt->current), key);
+    if (ln_isnodekey(ls, key)) {
         NUInode *node = lbind_check(L, 3, &lbT_Node);
         e->value = node;
     }
@@ -959,7 +984,7 @@ static int Lnode_addhandler(lua_State *L) {
 static int Lnode_delhandler(lua_State *L) {
     NUInode *n = lbind_check(L, 1, &lbT_Node);
     LNUIlua *ls = ln_statefromS(nui_state(n));
-    NUIkey *type = ln_checkkey(ls->S, L, 2);
+    NUIkey *type = ln_findkey(ls->S, L, 2);
     void *ud = (void*)lua_topointer(L, 3);
     int capture = lua_toboolean(L, 4);
     luaL_checktype(L, 3, LUA_TFUNCTION);
@@ -1039,6 +1064,27 @@ static int Lnode_new(lua_State *L) {
     return 1;
 }
 
+static int Lnode_newnodes(lua_State *L) {
+    NUIstate *S = ln_checkstate(L, 1);
+    LNUIlua *ls = ln_statefromS(S);
+    lua_Integer count = luaL_checkinteger(L, 2);
+    NUInode **nodes;
+    size_t i, n;
+    luaL_argcheck(L, count >= 0, 2, "negative node count");
+    if (count > (lua_Integer)(NUI_MAX_SIZET/sizeof(NUInode*)))
+        luaL_argerror(L, 2, "node count too large");
+    nodes = (NUInode**)lua_newuserdata(L, (size_t)count*sizeof(NUInode*));
+    n = nui_newnodes(S, (size_t)count, nodes);
+    lua_createtable(L, (int)n, 0);
+    for (i = 0; i < n; ++i) {
+        nui_addcomp(nodes[i], &ls->base);
+        lbind_wrap(L, nodes[i], &lbT_Node);
+        nui_retain(nodes[i]);
+        lua_rawseti(L, -2, (int)i + 1);
+    }
+    return 1;
+}
+
 static int Lnode_delete(lua_State *L) {
     NUInode *n = (NUInode*)lbind_test(L, 1, &lbT_Node);
     if (n) nui_release(n);
@@ -1275,6 +1321,7 @@ static void open_node(lua_State *L) {
         { "__gc", Lnode_delete },
         { "__len", Lnode_childcount },
         ENTRY(new),
+        ENTRY(newnodes),
         ENTRY(delete),
         ENTRY(setenv),
         ENTRY(retain),
@@ -1,8 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #define NUI_IMPLEMENTATION
+#define NUI_USE_STATICKEY
 #include "nui.h"
 
 static size_t allmem;
+static size_t nmallocs;
 
 static void *debug_alloc(NUIparams *params, void *ptr, size_t nsize, size_t osize) {
     if (params->S == NULL) {
@@ -22,6 +26,7 @@ static void *debug_alloc(NUIparams *params, void *ptr, size_t nsize, size_t osiz
     if (ptr == NULL) {
         assert(osize == 0);
         allmem += nsize;
+        ++nmallocs;
         printf("[M] malloc:  %d (%d)\n", (int)allmem, (int)nsize);
         return malloc(nsize);
     }
@@ -258,6 +263,703 @@ static void test_event(void) {
     nui_close(S);
 }
 
+static char dispatch_log[32];
+static const char *tag_d = "d", *tag_e = "e", *tag_n = "n";
+
+static void log_handler(void *ud, NUInode *n, const NUIevent *evt) {
+    (void)n, (void)evt;
+    strcat(dispatch_log, (const char*)ud);
+}
+
+static void churn_handler(void *ud, NUInode *n, const NUIevent *evt) {
+    log_handler(ud, n, evt); /* remove one, add one while running */
+    nui_delhandler(n, evt->type, 0, log_handler, (void*)tag_e);
+    nui_addhandler(n, evt->type, 1, log_handler, (void*)tag_n);
+}
+
+static void count_handler(void *ud, NUInode *n, const NUIevent *evt)
+{ (void)n, (void)evt; ++*(int*)ud; }
+
+static void test_dispatch(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *p = nui_newnode(S), *t = nui_newnode(S), *q;
+    NUIevent evt, pong;
+    int i, called = 0;
+    nui_setparent(p, nui_rootnode(S));
+    nui_setparent(t, p);
+    nui_addhandler(p, NUI_(ping), 0, log_handler, "y");
+    nui_addhandler(p, NUI_(ping), 1, log_handler, "a");
+    nui_addhandler(p, NUI_(ping), 1, log_handler, "b");
+    nui_addhandler(t, NUI_(ping), 0, churn_handler, (void*)tag_d);
+    nui_addhandler(t, NUI_(ping), 0, log_handler, (void*)tag_e);
+    nui_addhandler(t, NUI_(ping), 1, log_handler, "c");
+    nui_defhandler(t, NUI_(ping), log_handler, "z");
+    nui_initevent(&evt, NUI_(ping), 1, 0);
+    nui_emitevent(t, &evt);
+    assert(strcmp(dispatch_log, "abcdyz") == 0);
+    dispatch_log[0] = '\0';
+    nui_delhandler(t, NUI_(ping), 0, churn_handler, (void*)tag_d);
+    nui_emitevent(t, &evt);
+    assert(strcmp(dispatch_log, "abcnyz") == 0);
+    dispatch_log[0] = '\0';
+    for (i = 0; i < 5000; ++i) { /* deep path costs no C stack */
+        NUInode *child = nui_newnode(S);
+        nui_setparent(child, t);
+        t = child;
+    }
+    nui_emitevent(t, &evt);
+    assert(strcmp(dispatch_log, "abcny") == 0);
+    assert(S->pathtop == 0);
+    dispatch_log[0] = '\0'; /* listener summaries follow the tree */
+    nui_addhandler(p, NUI_(pong), 0, log_handler, "p");
+    q = nui_newnode(S);
+    nui_addhandler(q, NUI_(pong), 1, log_handler, "q");
+    nui_setparent(nui_newnode(S), q);
+    nui_append(t, q);
+    nui_initevent(&pong, NUI_(pong), 1, 0);
+    nui_emitevent(nui_nextchild(q, NULL), &pong);
+    nui_emitevent(t, &pong);
+    assert(strcmp(dispatch_log, "qpp") == 0);
+    nui_freeevent(S, &pong);
+    for (i = 0; i < 40; ++i) { /* more types than listenmask bits */
+        char buff[32];
+        sprintf(buff, "event%d", i);
+        nui_addhandler(p, nui_newkey(S, buff, strlen(buff)), i & 1,
+                count_handler, &called);
+    }
+    for (i = 0; i < 80; ++i) {
+        char buff[32];
+        sprintf(buff, "event%d", i);
+        nui_initevent(&pong, nui_newkey(S, buff, strlen(buff)), 1, 0);
+        nui_emitevent(t, &pong);
+        nui_freeevent(S, &pong);
+    }
+    assert(called == 40);
+    called = 0; /* path pins are given back */
+    nui_addhandler(t, NUI_(delete_node), 0, count_handler, &called);
+    nui_emitevent(t, &evt);
+    nui_detach(t);
+    nui_waitevents(S, 0);
+    assert(called == 1);
+    nui_freeevent(S, &evt);
+    nui_close(S);
+}
+
+static void nest_handler(void *ud, NUInode *n, const NUIevent *evt) {
+    NUIstate *S = nui_state(n);
+    NUInode *child = (NUInode*)get_event_data(evt, NUI_(child));
+    ++*(int*)ud;
+    if (nui_parent(nui_parent(child)) == n) {
+        nui_setparent(nui_newnode(S), child); /* nested add_child */
+        assert(get_event_data(evt, NUI_(child)) == child);
+    }
+}
+
+static void nochild_handler(void *ud, NUInode *n, const NUIevent *evt) {
+    NUIstate *S = nui_state(n);
+    assert(nui_gettable(nui_eventdata(evt), NUI_(child)) == NULL);
+    assert(nui_eventdata(evt)->count == 0);
+    ++*(int*)ud;
+}
+
+static void test_mutation(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *q = nui_newnode(S), *m;
+    int i, added = 0, nested = 0, deleted = 0;
+    nui_setparent(q, nui_rootnode(S));
+    for (i = 0; i < 10; ++i) /* nobody listens */
+        nui_setparent(nui_newnode(S), q);
+    assert(S->nlisteners[NUI_add_child] == 0);
+    assert(S->mutation.data.size == 0);
+    nui_addhandler(q, NUI_(add_child), 0, count_handler, &added);
+    assert(S->nlisteners[NUI_add_child] == 1);
+    for (i = 0; i < 10; ++i)
+        nui_setparent(nui_newnode(S), q);
+    assert(added == 10);
+    nui_addhandler(nui_rootnode(S), NUI_(add_child), 1, nest_handler, &nested);
+    nui_setparent(m = nui_newnode(S), q);
+    assert(added == 11 && nested == 2 && nui_childcount(m) == 1);
+    nui_addhandler(nui_newnode(S), NUI_(delete_node), 0,
+            nochild_handler, &deleted);
+    nui_setparent(nui_newnode(S), q); /* reused event had child set */
+    nui_detach(q);
+    nui_waitevents(S, 0);
+    assert(deleted == 1);
+    assert(S->nlisteners[NUI_add_child] == 1);
+    nui_close(S);
+}
+
+static size_t observed[4];
+static int observe_calls;
+
+static void log_records(void *ud, NUInode *n, const NUIrecord *records, size_t count) {
+    NUIstate *S = nui_state(n);
+    size_t i, j;
+    ++observe_calls;
+    for (i = 0; i < count; ++i) {
+        const NUIrecord *r = &records[i];
+        observed[r->type] += r->type == NUI_ATTRCHANGED ? 1 : r->count;
+        for (j = 0; j < r->count && r->type == NUI_ADDED; ++j)
+            assert(nui_parent(r->nodes[j]) == r->target);
+    }
+    if (ud != NULL) { /* recorded for next flush */
+        nui_setparent(nui_newnode(S), n);
+        nui_unobserve(n, log_records, ud);
+        nui_observe(n, log_records, NULL);
+    }
+}
+
+static void on_observer_event(void *ud, NUInode *n, const NUIevent *evt)
+{ (void)ud, (void)n, (void)evt; }
+
+static void test_observe(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *p = nui_newnode(S), *q = nui_newnode(S), *r = nui_newnode(S), *c;
+    NUIattr attr = { NULL };
+    int i, deleted = 0;
+    nui_setparent(p, nui_rootnode(S));
+    nui_setparent(q, nui_rootnode(S));
+    nui_setparent(r, nui_rootnode(S));
+    for (i = 0; i < 10; ++i)
+        nui_setparent(nui_newnode(S), p);
+    for (i = 0; i < 100; ++i)
+        nui_setparent(nui_newnode(S), q);
+    assert(S->observed.count == 0); /* nobody observes */
+    assert(nui_observe(p, log_records, S));
+    assert(nui_observe(r, log_records, NULL));
+    nui_setchildren(p, nui_nextchild(q, NULL));
+    nui_setattr(nui_nextchild(p, NULL), NUI_(text), &attr);
+    nui_setattr(q, NUI_(text), &attr); /* not observed */
+    assert(S->observed.count == 3 && observe_calls == 0);
+    nui_waitevents(S, 0);
+    assert(observe_calls == 1);
+    assert(observed[NUI_REMOVED] == 10 && observed[NUI_ADDED] == 100);
+    assert(observed[NUI_ATTRCHANGED] == 1);
+    assert(S->observed.count == 1);
+    nui_waitevents(S, 0);
+    assert(observe_calls == 2 && observed[NUI_ADDED] == 101);
+    nui_unobserve(p, log_records, NULL);
+    assert(!(nui_nextchild(p, NULL)->pathmask & NUI_OBSERVERBIT));
+    nui_setparent(nui_newnode(S), p); /* r still observes, p is dropped */
+    assert(S->observed.count == 0);
+    nui_waitevents(S, 0);
+    assert(observe_calls == 2);
+    c = nui_newnode(S); /* pins of records and observers are given back */
+    nui_setparent(nui_newnode(S), r); /* observed by r, deep below it */
+    nui_setparent(c, nui_nextchild(r, NULL));
+    nui_addhandler(c, NUI_(delete_node), 0, count_handler, &deleted);
+    nui_setparent(nui_newnode(S), c);
+    assert(nui_observe(c, log_records, NULL));
+    nui_waitevents(S, 0);
+    nui_unobserve(c, log_records, NULL);
+    nui_detach(c);
+    nui_waitevents(S, 0);
+    assert(deleted == 1);
+    nui_addhandler(q, NUI_(observer), 0, on_observer_event, NULL);
+    assert(!(q->pathmask & NUI_OBSERVERBIT)); /* just an event type */
+    assert(q->ext->hot[nuiE_typeid(S, NUI_(observer), 0)] != NULL);
+    nui_close(S);
+}
+
+static size_t posted_sum;
+
+static void sum_handler(void *ud, NUInode *n, const NUIevent *evt) {
+    NUIstate *S = nui_state(n);
+    ++*(int*)ud;
+    posted_sum += (size_t)get_event_data(evt, NUI_(x));
+    if (get_event_data(evt, NUI_(repost)) != NULL) {
+        NUIevent again;
+        nui_initevent(&again, NUI_(tick), 0, 0);
+        nui_postevent(n, &again, 0);
+        nui_freeevent(S, &again);
+    }
+}
+
+static int merge_scroll(void *ud, NUIevent *queued, const NUIevent *evt) {
+    NUIstate *S = (NUIstate*)ud;
+    NUIptrentry *e = (NUIptrentry*)nui_gettable(nui_eventdata(queued), NUI_(x));
+    e->value = (char*)e->value + (size_t)get_event_data(evt, NUI_(x));
+    return 1;
+}
+
+static void test_postevent(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *n = nui_newnode(S);
+    NUIevent evt;
+    NUInode *d;
+    int moves = 0, clicks = 0, scrolls = 0, ticks = 0, deleted = 0;
+    size_t i;
+    nui_setparent(n, nui_rootnode(S));
+    nui_addhandler(n, NUI_(move), 0, sum_handler, &moves);
+    nui_addhandler(n, NUI_(click), 0, sum_handler, &clicks);
+    nui_addhandler(n, NUI_(scroll), 0, sum_handler, &scrolls);
+    nui_addhandler(n, NUI_(tick), 0, sum_handler, &ticks);
+    nui_setmerge(S, NUI_(scroll), merge_scroll, S);
+    for (i = 1; i <= 1000; ++i) {
+        nui_initevent(&evt, NUI_(move), 1, 0);
+        set_event_data(S, &evt, NUI_(x), (void*)i);
+        assert(nui_postevent(n, &evt, NUI_COALESCE));
+        nui_freeevent(S, &evt);
+        nui_initevent(&evt, NUI_(scroll), 1, 0);
+        set_event_data(S, &evt, NUI_(x), (void*)(size_t)2);
+        assert(nui_postevent(n, &evt, NUI_COALESCE));
+        nui_freeevent(S, &evt);
+    }
+    for (i = 0; i < 3; ++i) {
+        nui_initevent(&evt, NUI_(click), 1, 0);
+        set_event_data(S, &evt, NUI_(repost), n);
+        nui_postevent(n, &evt, 0);
+        nui_freeevent(S, &evt);
+    }
+    assert(moves == 0 && S->posted.count == 5);
+    nui_waitevents(S, 0);
+    assert(moves == 1 && scrolls == 1 && clicks == 3 && ticks == 0);
+    assert(posted_sum == 1000 + 2000); /* last move, merged scrolls */
+    nui_waitevents(S, 0); /* posted while flushing */
+    assert(ticks == 3 && S->posted.count == 0);
+    d = nui_newnode(S); /* pin of a deep target is given back */
+    nui_setparent(d, n);
+    nui_addhandler(d, NUI_(delete_node), 0, count_handler, &deleted);
+    nui_initevent(&evt, NUI_(move), 1, 0);
+    nui_postevent(d, &evt, 0);
+    nui_freeevent(S, &evt);
+    nui_waitevents(S, 0);
+    assert(moves == 2);
+    nui_detach(d);
+    nui_waitevents(S, 0);
+    assert(deleted == 1);
+    nui_initevent(&evt, NUI_(move), 1, 0);
+    nui_postevent(n, &evt, 0); /* pending at close */
+    nui_freeevent(S, &evt);
+    nui_close(S);
+}
+
+static void test_trim(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIattr attr = { NULL };
+    NUInode *n;
+    NUItype *t;
+    size_t peak, pages, nallocs;
+    int i;
+    for (i = 0; i < 1000; ++i)
+        nui_setattr(nui_newnode(S), NUI_(attr), &attr);
+    peak = allmem;
+    pages = S->nodepool.npages;
+    printf("trim: %d bytes in %d node pages\n", (int)peak, (int)pages);
+    nui_waitevents(S, 0); /* sweep all pending nodes */
+    assert(nui_trimpool(S, &S->nodepool) > 0);
+    assert(S->nodepool.npages == 0 && S->nodepool.freed == NULL);
+    assert(S->nodepool.nfree == 0);
+    assert(nui_trim(S) > 0);
+    assert(allmem < peak);
+    printf("trim: %d bytes after trim\n", (int)allmem);
+
+    params.trim_threshold = 1;
+    nui_newnode(S);
+    n = nui_newnode(S);
+    nui_retain(n);
+    nui_waitevents(S, 0); /* trim page holds one living node */
+    assert(S->nodepool.npages == 1 && S->nodepool.nfree != 0);
+    assert(S->trimfree != 0 && S->trimfree == nuiM_freebytes(S));
+    nallocs = nmallocs;
+    nui_waitevents(S, 0); /* nothing freed since, no trim */
+    assert(nmallocs == nallocs);
+
+    t = nui_newtype(S, NUI_(large), 0, 5000); /* large comps are pooled */
+    nui_addcomp(n, t);
+    nui_addcomp(nui_newnode(S), t);
+    assert(t->comp_pool.npages == 1);
+    nui_close(S);
+}
+
+typedef struct IntEntry { NUIentry base; int value; } IntEntry;
+
+static void test_table(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIkey *keys[1000];
+    NUIentry *e = NULL;
+    NUItable t;
+    char buff[32];
+    int i, count = 0;
+    nui_inittable(&t, sizeof(IntEntry));
+    for (i = 0; i < 1000; ++i) {
+        sprintf(buff, "entry%d", i);
+        keys[i] = nui_newkey(S, buff, strlen(buff));
+        ((IntEntry*)nui_settable(S, &t, keys[i]))->value = i;
+        assert(i >= NUI_LINEARSIZE || t.size <= NUI_LINEARSIZE);
+    }
+    for (i = 0; i < 1000; ++i) {
+        const IntEntry *ie = (const IntEntry*)nui_gettable(&t, keys[i]);
+        assert(ie != NULL && ie->value == i);
+        assert((IntEntry*)nui_settable(S, &t, keys[i]) == ie);
+    }
+    assert(nui_gettable(&t, NUI_(notentry)) == NULL);
+    while (nui_nextentry(&t, &e)) {
+        assert(((IntEntry*)e)->value == atoi((char*)e->key + 5));
+        ++count;
+    }
+    assert(count == 1000);
+    assert(nui_resizetable(S, &t, 4000) >= 4000);
+    assert(((const IntEntry*)nui_gettable(&t, keys[999]))->value == 999);
+    for (i = 0; i < 1000; i += 2) {
+        assert(nui_deltable(S, &t, keys[i]));
+        assert(!nui_deltable(S, &t, keys[i]));
+    }
+    for (i = 0; i < 1000; ++i) {
+        const IntEntry *ie = (const IntEntry*)nui_gettable(&t, keys[i]);
+        assert(i % 2 ? ie != NULL && ie->value == i : ie == NULL);
+    }
+    assert(t.count == 500 && t.size <= 2048);
+    for (i = 1; i < 990; i += 2)
+        assert(nui_deltable(S, &t, keys[i]));
+    assert(t.count == 5 && t.size <= 32); /* shrinked */
+    for (i = 0; i < 1000; ++i) {
+        const IntEntry *ie = (const IntEntry*)nui_gettable(&t, keys[i]);
+        assert(i % 2 && i > 990 ? ie != NULL && ie->value == i : ie == NULL);
+    }
+    for (i = 0; i < 100; ++i)
+        ((IntEntry*)nui_settable(S, &t, keys[i]))->value = -i;
+    for (i = 0; i < 100; ++i)
+        assert(((const IntEntry*)nui_gettable(&t, keys[i]))->value == -i);
+    nui_freetable(S, &t);
+    nui_inittable(&t, sizeof(IntEntry)); /* small tables are linear */
+    for (i = 0; i < 3; ++i)
+        ((IntEntry*)nui_settable(S, &t, keys[i]))->value = i;
+    assert(nui_resizetable(S, &t, 64) >= 64);
+    assert(nui_resizetable(S, &t, 0) == NUI_LINEARSIZE);
+    for (i = 0; i < 3; ++i)
+        assert(((const IntEntry*)nui_gettable(&t, keys[i]))->value == i);
+    assert(nui_gettable(&t, keys[3]) == NULL);
+    for (i = 0; i < 3; ++i)
+        assert(nui_deltable(S, &t, keys[i]));
+    assert(nui_resizetable(S, &t, 0) == 0); /* empty table is freed */
+    assert(t.hash == NULL && t.size == 0);
+    ((IntEntry*)nui_settable(S, &t, keys[0]))->value = 7;
+    assert(((const IntEntry*)nui_gettable(&t, keys[0]))->value == 7);
+    nui_freetable(S, &t);
+    nui_close(S);
+}
+
+static void test_strt(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIkey *keys[5000], *key = nui_usekey(NUI_KEY(S, churn));
+    size_t nuse = S->strt.nuse;
+    char buff[32];
+    int i, rehashing = 0;
+    nui_delkey(S, key);
+    nui_waitevents(S, 0);
+    assert(nui_usekey(NUI_KEY(S, churn)) == key); /* revived */
+    nui_delkey(S, key);
+    nui_waitevents(S, 0);
+    nui_waitevents(S, 0);
+    assert(S->strt.nuse == nuse - 1);
+    for (i = 0; i < 5000; ++i) {
+        sprintf(buff, "key%d", i);
+        keys[i] = nui_usekey(nui_newkey(S, buff, strlen(buff)));
+        if (S->strt.oldhash != NULL) { /* keys found in both tables */
+            ++rehashing;
+            assert(nui_newkey(S, "key0", 4) == keys[0]);
+            assert(nui_newkey(S, buff, strlen(buff)) == keys[i]);
+        }
+    }
+    assert(rehashing != 0 && S->strt.size >= 4096);
+    for (i = 0; i < 4990; ++i)
+        nui_delkey(S, keys[i]);
+    assert(S->strt.nuse >= 5000); /* swept in later ticks */
+    while (S->strt.gclist != NULL || S->strt.oldgc != NULL)
+        nui_waitevents(S, 0);
+    nui_waitevents(S, 0);
+    assert(S->strt.oldhash == NULL && S->strt.size < 4096);
+    for (i = 4990; i < 5000; ++i) {
+        sprintf(buff, "key%d", i);
+        assert(nui_newkey(S, buff, strlen(buff)) == keys[i]);
+        nui_delkey(S, keys[i]);
+    }
+    nui_close(S);
+}
+
+static NUIdata *echo_key(NUIattr *attr, NUInode *n, NUIkey *key) {
+    return nui_newdata(nui_state(n), (const char*)key, nui_keylen(key));
+}
+
+static int attrs_deleted;
+
+static void del_others(NUIattr *attr, NUInode *n) {
+    NUIstate *S = nui_state(n);
+    char buff[32];
+    int i;
+    ++attrs_deleted;
+    for (i = 0; i < 64; ++i) { /* would shrink the table being cleared */
+        sprintf(buff, "attr%d", i);
+        nui_delattr(n, nui_newkey(S, buff, strlen(buff)));
+    }
+}
+
+static void test_clearattrs(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *n = nui_newnode(S);
+    NUIattr attr = { NULL, NULL, del_others };
+    char buff[32];
+    int i;
+    nui_setparent(n, nui_rootnode(S));
+    for (i = 0; i < 64; ++i) {
+        sprintf(buff, "attr%d", i);
+        nui_setattr(n, nui_newkey(S, buff, strlen(buff)), &attr);
+    }
+    nui_detach(n);
+    nui_waitevents(S, 0);
+    assert(attrs_deleted == 64); /* each once, none by nui_delattr */
+    nui_close(S);
+}
+
+static void test_findkey(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *n = nui_newnode(S);
+    NUIattr handler = { echo_key };
+    NUIdata *d;
+    size_t nuse = S->strt.nuse, total;
+    NUImemstats ms;
+    nui_memstats(S, &ms);
+    total = ms.total;
+    assert(nui_findkey(S, "nothere", 7) == NULL);
+    assert(nui_get(n, nui_findkey(S, "nothere", 7)) == NULL);
+    assert(nui_getattr(n, nui_findkey(S, "nothere", 7)) == NULL);
+    assert(nui_gettype(S, nui_findkey(S, "nothere", 7)) == NULL);
+    assert(nui_getcomp(n, nui_gettype(S, NULL)) == NULL);
+    nui_memstats(S, &ms);
+    assert(S->strt.nuse == nuse && ms.total == total);
+    assert(nui_findkey(S, "child", 5) == NUI_(child));
+    assert(!nui_hasattrhandler(n));
+    nui_addattrhandler(n, &handler); /* handler-only attribute */
+    assert(nui_hasattrhandler(n) && !nui_findkey(S, "virtual", 7));
+    d = nui_get(n, nui_newkey(S, "virtual", 7));
+    assert(d != NULL && strcmp((char*)d, "virtual") == 0);
+    nui_deldata(S, d);
+    nui_close(S);
+}
+
+static NUIkey *margin_key(NUIstate *S) { return NUI_(style.margin); }
+
+static void test_freezetypes(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUItype *types[100], *late;
+    char buff[32], seen[101] = { 0 };
+    size_t i;
+    assert(nui_freezetypes(S) == 0);
+    for (i = 0; i < 100; ++i) {
+        sprintf(buff, "type%d", (int)i);
+        types[i] = nui_newtype(S, nui_newkey(S, buff, strlen(buff)), 0, 0);
+    }
+    assert(nui_freezetypes(S) == 100);
+    for (i = 0; i < 100; ++i) {
+        assert(nui_gettype(S, types[i]->name) == types[i]);
+        assert(types[i]->index >= 1 && types[i]->index <= 100);
+        assert(!seen[types[i]->index]); /* dense and unique */
+        seen[types[i]->index] = 1;
+    }
+    assert(nui_gettype(S, NUI_(notype)) == NULL);
+    assert(nui_gettype(S, NULL) == NULL);
+    late = nui_newtype(S, NUI_(late), 0, 0); /* falls back to table */
+    assert(late->index == 0 && nui_gettype(S, NUI_(late)) == late);
+    assert(nui_freezetypes(S) == 101 && late->index != 0);
+    nui_close(S);
+}
+
+static void test_keycache(void) {
+    NUIparams params1 = { debug_alloc }, params2 = { NULL };
+    NUIstate *S1 = nui_newstate(&params1);
+    NUIstate *S2 = nui_newstate(&params2);
+    NUIkey *key = margin_key(S1);
+    assert(key == nui_newkey(S1, "style.margin", 12));
+    assert(margin_key(S1) == key);
+    assert(margin_key(S2) == nui_newkey(S2, "style.margin", 12));
+    assert(margin_key(S1) == key); /* callsite switched back */
+    nui_close(S1);
+    assert(margin_key(S2) == nui_newkey(S2, "style.margin", 12));
+    nui_close(S2);
+}
+
+static void test_newnodes(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUInode *nodes[1000], *single = nui_newnode(S), *n;
+    NUImemstats ms;
+    size_t i, count = 0;
+    assert(nui_newnodes(S, 1000, nodes) == 1000);
+    for (n = single; n != NULL; n = nui_nextsibling(single, n))
+        ++count;
+    assert(count == 1001 && nui_nextsibling(single, single) == nodes[0]);
+    for (i = 0; i < 1000; ++i) {
+        assert(nodes[i]->S == S && nodes[i]->parent == NULL);
+        nui_retain(nodes[i]);
+    }
+    for (i = 0; i < 10; ++i)
+        nui_setparent(nodes[i], nui_rootnode(S));
+    assert(nui_childcount(nui_rootnode(S)) == 10);
+    nui_releasenodes(nodes + 10, 990);
+    nui_waitevents(S, 0);
+    nui_memstats(S, &ms);
+    assert(ms.nodes.live == 10);
+    nui_close(S);
+}
+
+static void test_memstats(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUItype *t = open_name_type(S);
+    NUImemstats ms;
+    size_t peak;
+    int i;
+    for (i = 0; i < 100; ++i)
+        new_named_node(S, "stats");
+    nui_memstats(S, &ms);
+    printf("memstats: total=%d peak=%d nodes=%d/%d keys=%d tables=%d\n",
+            (int)ms.total, (int)ms.peak, (int)ms.nodes.live,
+            (int)ms.nodes.bytes, (int)ms.keys, (int)ms.tablebytes);
+    assert(ms.total == allmem && ms.peak >= ms.total);
+    assert(ms.nodes.live == 100 && ms.comps.live == 100);
+    assert(ms.exts.live == 100 && ms.nodes.objsize == sizeof(NUInode));
+    nui_newnode(S); /* plain nodes have no tables */
+    nui_memstats(S, &ms);
+    assert(ms.nodes.live == 101 && ms.exts.live == 100);
+    assert(ms.tablebytes != 0 && ms.keys != 0);
+    assert(nui_nexttype(S, NULL) == t && nui_nexttype(S, t) == NULL);
+
+    peak = ms.peak;
+    nui_setchildren(nui_rootnode(S), NULL);
+    nui_waitevents(S, 0);
+    nui_trim(S);
+    nui_memstats(S, &ms);
+    assert(ms.total == allmem && ms.peak >= peak && ms.total < peak);
+    assert(ms.nodes.live == 0 && ms.comps.live == 0 && ms.exts.live == 0);
+    nui_resetpeak(S);
+    nui_memstats(S, &ms);
+    assert(ms.peak == ms.total);
+    nui_close(S);
+}
+
+static NUIdata *get_transient(NUIattr *attr, NUInode *n, NUIkey *key) {
+    return nui_newtransient(nui_state(n), (const char*)key, nui_keylen(key));
+}
+
+static NUIdata *get_owned(NUIattr *attr, NUInode *n, NUIkey *key) {
+    return nui_newdata(nui_state(n), (const char*)key, nui_keylen(key));
+}
+
+static void test_transient(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIattr tattr = { get_transient }, oattr = { get_owned };
+    NUInode *n = nui_newnode(S);
+    NUIdata *d1, *d2;
+    size_t used;
+    nui_retain(n);
+    nui_setattr(n, NUI_(transient), &tattr);
+    nui_setattr(n, NUI_(owned), &oattr);
+
+    d1 = nui_gettransient(n, NUI_(transient));
+    used = S->transient.used;
+    assert(strcmp((char*)d1, "transient") == 0 && nui_len(d1) == 9);
+    d2 = nui_gettransient(n, NUI_(owned));
+    assert(strcmp((char*)d2, "owned") == 0);
+    nui_deldata(S, d2); /* last allocation goes back to arena */
+    assert(S->transient.used == used);
+
+    d2 = nui_get(n, NUI_(transient)); /* owned copy of transient data */
+    assert(S->transient.used == used);
+    assert(strcmp((char*)d2, "transient") == 0 && d2 != d1);
+    nui_deldata(S, d2);
+
+    nui_waitevents(S, 0);
+    assert(S->transient.used == sizeof(NUIpage));
+    nui_close(S);
+}
+
+typedef struct CachedAttr {
+    NUIattr base;
+    NUIdata *value;
+} CachedAttr;
+
+static NUIdata *get_cached(NUIattr *attr, NUInode *n, NUIkey *key) {
+    (void)key;
+    return nui_usedata(nui_state(n), ((CachedAttr*)attr)->value);
+}
+
+static void test_shared(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    CachedAttr cattr = { { get_cached } };
+    NUInode *n = nui_newnode(S);
+    NUIdata *d1, *d2, *d3;
+    nui_retain(n);
+    cattr.value = nui_newshared(S, "cached", 6);
+    nui_setattr(n, NUI_(cached), &cattr.base);
+
+    d1 = nui_get(n, NUI_(cached));
+    d2 = nui_get(n, NUI_(cached));
+    assert(d1 == cattr.value && d2 == cattr.value); /* no copies */
+    d3 = nui_writedata(S, d2); /* copy on write */
+    assert(d3 != d2 && strcmp((char*)d3, "cached") == 0);
+    nui_deldata(S, d3);
+    d2 = nui_gettransient(n, NUI_(cached));
+    assert(d2 != d1 && strcmp((char*)d2, "cached") == 0);
+    nui_dropdata(S, d1);
+    assert(nui_writedata(S, cattr.value) == cattr.value); /* unique */
+    nui_dropdata(S, cattr.value);
+
+    d1 = nui_newdata(S, "owned", 5); /* take a reference copies once */
+    d2 = nui_usedata(S, d1);
+    d3 = nui_usedata(S, d2);
+    assert(d2 != d1 && d3 == d2 && nui_len(d3) == 5);
+    nui_deldata(S, d1);
+    nui_dropdata(S, d2);
+    nui_dropdata(S, d3);
+    nui_close(S);
+}
+
+static void test_buffer(void) {
+    NUIparams params = { debug_alloc };
+    NUIstate *S = nui_newstate(&params);
+    NUIbuffer B;
+    NUIdata *d;
+    char *p;
+    int i;
+    nui_initbuffer(S, &B);
+    nui_addstring(&B, "hello");
+    nui_addchar(&B, ',');
+    nui_addfstring(&B, " %s #%d", "world", 1);
+    assert(B.b == B.init);
+    d = nui_buffresult(&B);
+    assert(strcmp((char*)d, "hello, world #1") == 0 && nui_len(d) == 15);
+    nui_deldata(S, d);
+
+    nui_initbuffer(S, &B); /* grows out of the stack buffer */
+    for (i = 0; i < 100; ++i)
+        nui_addfstring(&B, "[%02d]", i);
+    assert(B.b != B.init && nui_bufflen(&B) == 400);
+    p = B.b;
+    d = nui_buffresult(&B);
+    assert(nui_len(d) == 400 && memcmp((char*)d + 396, "[99]", 5) == 0);
+    assert((char*)d == p); /* handed over without copy */
+    nui_deldata(S, d);
+
+    nui_initbuffer(S, &B);
+    for (i = 0; i < NUI_BUFFERSIZE*10; ++i)
+        nui_addchar(&B, 'a' + i % 26);
+    nui_freebuffer(&B);
+    nui_close(S);
+}
+
 static NUItime on_timer(void *ud, NUItimer *t, NUItime elapsed) {
     printf("on_timer: %p: %u\n", t, elapsed);
     return ud ? 1000 : 0;
@@ -280,6 +982,22 @@ int main(void) {
     test_mem();
     test_node();
     test_event();
+    test_dispatch();
+    test_mutation();
+    test_observe();
+    test_postevent();
+    test_table();
+    test_strt();
+    test_findkey();
+    test_clearattrs();
+    test_freezetypes();
+    test_keycache();
+    test_newnodes();
+    test_trim();
+    test_memstats();
+    test_transient();
+    test_shared();
+    test_buffer();
     test_timer();
     return 0;
 }
@@ -96,6 +96,19 @@ function test_node()
    io.write("OK\n")
 end
 
+function test_attrhandler()
+   io.write("[TEST] attrhandler ... ")
+   local S = nui.new()
+   local n = S:node()
+   n:addattrhandler(S:attr(function(node, key)
+      if key == "never_interned_name" then return "virtual" end
+   end))
+   assert(n.never_interned_name == "virtual")
+   S:delete()
+   io.write("OK\n")
+end
+
 test_mem()
 test_node()
+test_attrhandler()
 